@@ -13,26 +13,49 @@
 #include <array>
 #include <cmath>
 #include <functional>
-
-#include "short_alloc.h"
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <sstream>
+#include <thread>
+#include <mutex>
+
+#include "arithmetic.h"
+#include "bytecode.h"
+#include "simd_eval.h"
+#include "jit.h"
+#include "thread_pool.h"
+#include "islands.h"
+#include "rng.h"
+#include "node_pool.h"
+#include "node_store.h"
+#include "fitness_cache.h"
+#include "selection.h"
+#include "sequence.h"
+#include "job_queue.h"
+#include "bench.h"
+#include "telemetry.h"
+#include "checkpoint.h"
+#include "solution_store.h"
+#include "enumerator.h"
+#include "search_control.h"
+#include "solver.h"
+
+#include <sys/wait.h>
 
 using namespace std;
 
 template <int MIN, int MAX>
 int getRand()
 {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<> dis(MIN, MAX);
-    return dis(gen);
+    return thread_rng().uniform(MIN, MAX);
 }
 
 int getRand(int min, int max)
 {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dis(min, max);
-    return dis(gen);
+    return thread_rng().uniform(min, max);
 }
 
 bool flip(double p = 0.5)
@@ -41,43 +64,35 @@ bool flip(double p = 0.5)
     return getRand<0,100-1>() < pp;
 }
 
-template <size_t N>
-int randFrom( const array<int, N> &values, array<int, N> probs)
-{
-    int sum = 0;
-    for_each(probs.begin(), probs.end(), [&sum](int &val) {
-        val += sum;
-        sum = val;
-    });
-    const int rand = getRand(0, sum-1);
-    size_t targetPos = distance(probs.begin(), 
-        find_if(probs.begin(), probs.end(), 
-            [rand](int element) { return element > rand; }));
-    return values[targetPos];
-}
+class Node;
+using NodePtr = NodeRef<const Node>;
 
-template <class T, size_t N = 80>
-auto& arenaFor()
+// Nodes are immutable and hash-consed: identical subtrees are one shared
+// node. They are only made through a NodeStore, make_node for the one of
+// the process.
+template <class T, class... Args>
+NodePtr make_node(Args&&... args)
 {
-    static arena<sizeof(T) * N, alignof(T)> a{};
-    return a;
+    return NodeStore::instance().make<T>(std::forward<Args>(args)...);
 }
 
-class Node;
-using NodePtr = Node*;
-NodePtr generate_operations();
-using GeneratorFn = std::function<NodePtr()>;
-
-class Node
+class Node : public StoredNode
 {
 public:
-    virtual ~Node() = default;
-    virtual int eval(size_t n, int xp, int xpp) const = 0;
+    // The terms before the current one end at `history`, and `sum` is
+    // their sum.
+    virtual int eval(size_t n, const int *history, int sum) const = 0;
     virtual int size() const = 0;
+    virtual int depth() const = 0;
     virtual void print(ostream &strm) const = 0;
-    virtual NodePtr getCopy() const = 0;
-    virtual void mutate(int &mut_ind, GeneratorFn gen_fn) = 0;
-    virtual NodePtr getByIndex(int &index) = 0;
+    // Subtree at preorder position `index`, this node being 0.
+    virtual const Node* getByIndex(int &index) const = 0;
+    // This tree with the subtree at preorder position `index` swapped for
+    // `node`. Only the path down to it is rebuilt, the rest is shared.
+    virtual NodePtr replace(int index, const NodePtr &node) const = 0;
+    virtual void compile(Program &prog) const = 0;
+    // Prefix order, see checkpoint.h.
+    virtual void encode(ByteWriter &out) const = 0;
 };
 
 
@@ -85,23 +100,33 @@ public:
 class Value : public Node
 {
 public:
+    static constexpr uint8_t tag = 1;
+
     Value(int _data) : data(_data) {}
-    ~Value() = default;
-    Value(const Value &val) = default;
-    int eval(size_t n, int xp, int xpp) const override { return data; }
+    static uint64_t hash_of(int _data) { return mix64(((uint64_t)tag << 32) | (uint32_t)_data); }
+    uint64_t hash() const override { return hash_of(data); }
+    bool equals(int _data) const { return data == _data; }
+    int eval(size_t n, const int *history, int sum) const override { return data; }
     int size() const override { return 1; }
+    int depth() const override { return 1; }
     void print(ostream &strm) const override { strm << data << " "; }
-
-    Node* getCopy() const override
+    void compile(Program &prog) const override { prog.emit(OpCode::Value, data); }
+    void encode(ByteWriter &out) const override
     {
-        return static_cast<Node*>(new Value(*this));
+        if (data >= 0 && data <= checkpoint_format::max_small_constant)
+        {
+            out.put_u8((uint8_t)(checkpoint_format::small_constant + data));
+        }
+        else
+        {
+            out.put_u8(checkpoint_format::any_constant);
+            out.put_varint(data);
+        }
     }
 
-    virtual void mutate(int &mut_ind, GeneratorFn gen_fn) {
-        mut_ind--;
-    }
+    NodePtr replace(int index, const NodePtr &node) const override { return node; }
 
-    virtual NodePtr getByIndex(int &index)
+    const Node* getByIndex(int &index) const override
     {
         if (index == 0)
         {
@@ -113,15 +138,6 @@ public:
             return nullptr;
         }
     }
-
-    void* Value::operator new (size_t count)
-    {
-        return arenaFor<Value>().allocate<alignof(Value)>(count);
-    }
-    void Value::operator delete(void *ptr)
-    {
-        arenaFor<Value>().deallocate((char*)ptr, sizeof(Value));
-    }
 private:
     int data;
 };
@@ -130,49 +146,106 @@ enum class VariableType : size_t
 {
     N,
     XP,
-    XPP
+    XPP,
+    Lag,
+    Sum
 };
 
-map<VariableType, string> VarTypeToStr = { {VariableType::N, "N"}, {VariableType::XP, "XP"}, {VariableType::XPP, "XPP"} };
+// A lag prints with how many terms back it reads, XP3 for [n - 3].
+const map<VariableType, string> VarTypeToStr = { {VariableType::N, "N"}, {VariableType::XP, "XP"}, {VariableType::XPP, "XPP"},
+    {VariableType::Lag, "XP"}, {VariableType::Sum, "SUM"} };
 
-//n, [n - 1], [n - 2]
+//n, [n - 1], [n - 2], [n - lag], [0] + ... + [n - 1]
 class Variable : public Node
 {
 public:
-    Variable(VariableType _type) : type(_type) {}
-    ~Variable() = default;
-    Variable(const Variable &val) = default;
-    virtual int eval(size_t n, int xp, int xpp) const override {
+    static constexpr uint8_t tag = 2;
+
+    Variable(VariableType _type, unsigned _lag = 0) : type(_type), lag(_lag) {}
+    static uint64_t hash_of(VariableType _type, unsigned _lag = 0)
+    {
+        return mix64(((uint64_t)tag << 32) | ((uint64_t)_lag << 8) | (uint64_t)_type);
+    }
+    uint64_t hash() const override { return hash_of(type, lag); }
+    bool equals(VariableType _type, unsigned _lag = 0) const { return type == _type && lag == _lag; }
+    virtual int eval(size_t n, const int *history, int sum) const override {
         switch (type)
         {
         case VariableType::N:
             return (int)n;
             break;
         case VariableType::XP:
-            return xp;
+            return history[-1];
             break;
         case VariableType::XPP:
-            return xpp;
+            return history[-2];
+            break;
+        case VariableType::Lag:
+            return history[-(ptrdiff_t)lag];
+            break;
+        case VariableType::Sum:
+            return sum;
             break;
         default:
-            throw exception("Shit happens 0");
+            throw runtime_error("Shit happens 0");
             break;
         }
         return 0;
     }
     virtual int size() const override { return 1; }
-    virtual void print(ostream &strm) const override { strm << VarTypeToStr[type] << " "; }
-
-    Node* getCopy() const override
+    virtual int depth() const override { return 1; }
+    virtual void print(ostream &strm) const override
     {
-        return static_cast<Node*>(new Variable(*this));
+        strm << VarTypeToStr.at(type);
+        if (type == VariableType::Lag)
+        {
+            strm << lag;
+        }
+        strm << " ";
     }
-
-    virtual void mutate(int &mut_ind, GeneratorFn gen_fn) {
-        mut_ind--;
+    virtual void compile(Program &prog) const override {
+        switch (type)
+        {
+        case VariableType::N:
+            prog.emit(OpCode::N);
+            break;
+        case VariableType::XP:
+            prog.emit(OpCode::XP);
+            break;
+        case VariableType::XPP:
+            prog.emit(OpCode::XPP);
+            break;
+        case VariableType::Lag:
+            prog.emit(OpCode::Lag, (int)lag);
+            break;
+        case VariableType::Sum:
+            prog.emit(OpCode::Sum);
+            break;
+        default:
+            throw runtime_error("Shit happens 2");
+            break;
+        }
+    }
+    void encode(ByteWriter &out) const override
+    {
+        switch (type)
+        {
+        case VariableType::Lag:
+            out.put_u8(checkpoint_format::lag);
+            out.put_varint(lag);
+            break;
+        case VariableType::Sum:
+            out.put_u8(checkpoint_format::sum);
+            break;
+        default:
+            out.put_u8((uint8_t)(checkpoint_format::variable + (uint8_t)type));
+            break;
+        }
     }
 
-    virtual NodePtr getByIndex(int &index)
+    NodePtr replace(int index, const NodePtr &node) const override { return node; }
+
+    const Node* getByIndex(int &index) const override
     {
         if (index == 0)
         {
@@ -185,100 +258,112 @@ public:
         }
     }
 
-    void* Variable::operator new (size_t count)
-    {
-        return arenaFor<Variable>().allocate<alignof(Variable)>(count);
-    }
-    void Variable::operator delete(void *ptr)
-    {
-        arenaFor<Variable>().deallocate((char*)ptr, sizeof(Variable));
-    }
-
 private:
     VariableType type;
+    unsigned lag;
 };
 
-enum class OperationType : size_t
+enum class OperationType : uint8_t
 {
     plus,
     minus,
     mul
 };
 
-map<OperationType, string> OpTypeToStr = { {OperationType::plus, "+"}, {OperationType::minus, "-"}, {OperationType::mul, "*"} };
+const map<OperationType, string> OpTypeToStr = { {OperationType::plus, "+"}, {OperationType::minus, "-"}, {OperationType::mul, "*"} };
 
 class Operation : public Node
 {
 public:
-    Operation(OperationType _operation, const std::pair<NodePtr, NodePtr> &_nodeStg) : operation(_operation), nodeStg(_nodeStg) {}
-    ~Operation() 
-    { 
-        delete nodeStg.first;
-        delete nodeStg.second;
+    static constexpr uint8_t tag = 3;
+
+    Operation(OperationType _operation, std::pair<NodePtr, NodePtr> _nodeStg) : operation(_operation), nodeStg(move(_nodeStg))
+    {
+        size_ = 1 + nodeStg.first->size() + nodeStg.second->size();
+        depth_ = (unsigned short)(1 + max(nodeStg.first->depth(), nodeStg.second->depth()));
+        hash_ = hash_of(operation, nodeStg);
+    }
+    // From the hashes of the children, so it depends on the content of the
+    // tree only: the search keys its caches with it, and a dead node's
+    // address may come back holding another tree.
+    static uint64_t hash_of(OperationType _operation, const std::pair<NodePtr, NodePtr> &_nodeStg)
+    {
+        return mix64(mix64(((uint64_t)tag << 32) ^ (uint64_t)_operation ^ _nodeStg.first->hash()) + _nodeStg.second->hash());
     }
-    Operation(const Operation &val) : operation(val.operation), nodeStg(make_pair(val.nodeStg.first->getCopy(), val.nodeStg.second->getCopy()))
+    uint64_t hash() const override { return hash_; }
+    bool equals(OperationType _operation, const std::pair<NodePtr, NodePtr> &_nodeStg) const
     {
+        return operation == _operation && nodeStg == _nodeStg;
     }
-    virtual int eval(size_t n, int xp, int xpp) const override {
+    virtual int eval(size_t n, const int *history, int sum) const override {
         switch (operation)
         {
         case OperationType::plus:
-            return nodeStg.first->eval( n, xp, xpp) + nodeStg.second->eval( n, xp, xpp);
+            return wrapping_add(nodeStg.first->eval( n, history, sum), nodeStg.second->eval( n, history, sum));
             break;
         case OperationType::minus:
-            return nodeStg.first->eval( n, xp, xpp) - nodeStg.second->eval( n, xp, xpp);
+            return wrapping_sub(nodeStg.first->eval( n, history, sum), nodeStg.second->eval( n, history, sum));
             break;
         case OperationType::mul:
-            return nodeStg.first->eval( n, xp, xpp) * nodeStg.second->eval( n, xp, xpp);
+            return wrapping_mul(nodeStg.first->eval( n, history, sum), nodeStg.second->eval( n, history, sum));
             break;
         default:
-            throw exception("Shit happens 1");
+            throw runtime_error("Shit happens 1");
             break;
         }
         return 0;
     }
-    virtual int size() const override { return 1 + nodeStg.first->size() + nodeStg.second->size(); }
+    virtual int size() const override { return size_; }
+    virtual int depth() const override { return depth_; }
     virtual void print(ostream &strm) const override {
-        strm << "( " << OpTypeToStr[operation] << " ";
+        strm << "( " << OpTypeToStr.at(operation) << " ";
         nodeStg.first->print(strm);
         nodeStg.second->print(strm);
         strm << ") ";
     }
-
-    Node* getCopy() const override
+    virtual void compile(Program &prog) const override {
+        nodeStg.first->compile(prog);
+        nodeStg.second->compile(prog);
+        switch (operation)
+        {
+        case OperationType::plus:
+            prog.emit(OpCode::Plus);
+            break;
+        case OperationType::minus:
+            prog.emit(OpCode::Minus);
+            break;
+        case OperationType::mul:
+            prog.emit(OpCode::Mul);
+            break;
+        default:
+            throw runtime_error("Shit happens 3");
+            break;
+        }
+    }
+    void encode(ByteWriter &out) const override
     {
-        return static_cast<Operation*>(new Operation(*this));
+        out.put_u8((uint8_t)(checkpoint_format::operation + (uint8_t)operation));
+        nodeStg.first->encode(out);
+        nodeStg.second->encode(out);
     }
 
-    virtual void mutate(int &mut_ind, GeneratorFn gen_fn)
+    NodePtr replace(int index, const NodePtr &node) const override
     {
-        mut_ind--;
-        if (mut_ind == 0)
+        if (index == 0)
         {
-            delete nodeStg.first;
-            nodeStg.first = gen_fn();
-            return;
+            return node;
         }
-
+        index--;
         int sz_left = nodeStg.first->size();
-        if (sz_left > mut_ind)
-        {
-            nodeStg.first->mutate(mut_ind, gen_fn);
-        }
-        else
+        if (index < sz_left)
         {
-            mut_ind -= sz_left;
-            if (mut_ind == 0)
-            {
-                delete nodeStg.second;
-                nodeStg.second = gen_fn();
-                return;
-            }
-            nodeStg.second->mutate(mut_ind, gen_fn);
+            return NodeStore::of(this).make<Operation>(operation, make_pair(nodeStg.first->replace(index, node), nodeStg.second));
         }
+        return NodeStore::of(this).make<Operation>(operation, make_pair(nodeStg.first, nodeStg.second->replace(index - sz_left, node)));
     }
 
-    virtual NodePtr getByIndex(int &index)
+    // Descends into the one child that holds the index.
+    const Node* getByIndex(int &index) const override
     {
         if (index == 0)
         {
@@ -287,26 +372,108 @@ public:
         else
         {
             index--;
-            NodePtr left =  nodeStg.first->getByIndex(index);
-            return left != nullptr ? left : nodeStg.second->getByIndex(index);
+            int sz_left = nodeStg.first->size();
+            if (index < sz_left)
+            {
+                return nodeStg.first->getByIndex(index);
+            }
+            index -= sz_left;
+            return nodeStg.second->getByIndex(index);
         }
     }
+private:
+    OperationType operation;
+    unsigned short depth_;
+    int size_;
+    uint64_t hash_;
+    std::pair<NodePtr, NodePtr> nodeStg;
+};
+
+// Terms back a formula may read at most.
+constexpr size_t max_lookback = 16;
 
-    void* Operation::operator new (size_t count)
+void check_lookback(size_t lookback)
+{
+    if (lookback < 2 || lookback > max_lookback)
     {
-        return arenaFor<Operation>().allocate<alignof(Operation)>(count);
+        throw invalid_argument("the lookback goes from 2 to " + to_string(max_lookback) + " terms");
     }
-    void Operation::operator delete(void *ptr)
+}
+
+// Relative odds of the variables a leaf is drawn from; each lag past XPP
+// gets `lag`. A weight of 0 leaves its variables out.
+struct VariableWeights
+{
+    uint32_t n = 50;
+    uint32_t xp = 1;
+    uint32_t xpp = 1;
+    uint32_t lag = 1;
+    uint32_t sum = 1;
+};
+
+// The leaves of a search, made in its node store: the constants 0..9 and
+// the variables, N, XP and XPP, the lags up to `lookback` terms back and,
+// with `prefix_sum`, SUM, with the table drawing them. Every leaf is kept
+// alive here, so taking one is a reference count rather than a store
+// lookup. Throws invalid_argument for a lookback out of 2..max_lookback or
+// no variable left to draw.
+class LeafChoice
+{
+public:
+    explicit LeafChoice(NodeStore &store = NodeStore::instance(), size_t lookback = 2, bool prefix_sum = false,
+        const VariableWeights &weights = VariableWeights())
+        : store_(store)
     {
-        arenaFor<Operation>().deallocate((char*)ptr, sizeof(Operation));
+        check_lookback(lookback);
+        for (int i = 0; i < 10; i++)
+        {
+            constants_[i] = store.make<Value>(i);
+        }
+        vector<uint32_t> odds;
+        auto add = [this, &odds](uint32_t weight, NodePtr variable) {
+            if (weight != 0)
+            {
+                odds.push_back(weight);
+                variables_.push_back(move(variable));
+            }
+        };
+        add(weights.n, store.make<Variable>(VariableType::N));
+        add(weights.xp, store.make<Variable>(VariableType::XP));
+        add(weights.xpp, store.make<Variable>(VariableType::XPP));
+        for (size_t k = 3; k <= lookback; k++)
+        {
+            add(weights.lag, store.make<Variable>(VariableType::Lag, (unsigned)k));
+        }
+        if (prefix_sum)
+        {
+            add(weights.sum, store.make<Variable>(VariableType::Sum));
+        }
+        if (variables_.empty())
+        {
+            throw invalid_argument("every variable has a weight of 0");
+        }
+        table_.assign(odds);
     }
+
+    NodeStore& store() const noexcept { return store_; }
+    const NodePtr& constant(size_t value) const { return constants_[value]; }
+    const NodePtr& variable() const { return variables_[table_.sample()]; }
+
 private:
-    OperationType operation;
-    std::pair<NodePtr, NodePtr> nodeStg;
+    NodeStore &store_;
+    array<NodePtr, 10> constants_;
+    vector<NodePtr> variables_;
+    DynamicAliasTable table_;
 };
 
+// In the store of the process, N, XP and XPP at 50:1:1.
+const LeafChoice& default_leaves()
+{
+    static const LeafChoice leaves;
+    return leaves;
+}
 
-NodePtr generate_operations()
+NodePtr generate_operations(const LeafChoice &leaves = default_leaves())
 {
     NodePtr root = nullptr;
     if (flip(0.6))
@@ -314,57 +481,111 @@ NodePtr generate_operations()
         switch (getRand<0, 1>())
         {
         case 0:
-            root = new Value(getRand< 0, 9>());
+            root = leaves.constant(getRand< 0, 9>());
             break;
         case 1:
-            root = new Variable((VariableType)(randFrom<3>({ 0,1,2 }, {50, 1, 1})));
+            root = leaves.variable();
             break;
         }
     }
     else
     {//   
-        const auto pair = make_pair(generate_operations(), generate_operations());
-        root = new Operation((OperationType)getRand<0, 2>(), pair);
+        auto pair = make_pair(generate_operations(leaves), generate_operations(leaves));
+        root = leaves.store().make<Operation>((OperationType)getRand<0, 2>(), move(pair));
     }
     return root;
 }
 
 template <size_t N>
-array<int, N> calculate(const NodePtr operation_tree, int xpp, int xp)
+array<int, N> calculate(const Node *operation_tree, int xpp, int xp)
 {
     constexpr size_t count = N;
     array<int, N> res_seq;
     res_seq[0] = xpp;
     res_seq[1] = xp;
+    int sum = wrapping_add(xpp, xp);
     for (size_t i = 2; i < count; i++)
     {
-        res_seq[i] = operation_tree->eval(i+1, res_seq[i-1], res_seq[i-2]);
+        res_seq[i] = operation_tree->eval(i+1, res_seq.data() + i, sum);
+        sum = wrapping_add(sum, res_seq[i]);
     }
     return res_seq;
 }
 
-template <class T, size_t N>
-double distance(const array<T, N> &lhs, const array<T, N> &rhs)
+template <size_t N>
+array<int, N> calculate(const Program &program, int xpp, int xp)
+{
+    array<int, N> res_seq;
+    res_seq[0] = xpp;
+    res_seq[1] = xp;
+    program.run_sequence(res_seq.data(), N);
+    return res_seq;
+}
+
+vector<int> calculate(const Program &program, int xpp, int xp, size_t count)
+{
+    vector<int> res_seq(max<size_t>(count, 2));
+    res_seq[0] = xpp;
+    res_seq[1] = xp;
+    program.run_sequence(res_seq.data(), count);
+    res_seq.resize(count);
+    return res_seq;
+}
+
+// Sequence of the program in `result`, which holds target.size() terms,
+// and its squared error against the target, given up on once past `limit`
+// (see Program::run_scored).
+uint64_t calculate_error(const Program &program, SequenceView target, int *result, uint64_t limit = UINT64_MAX)
 {
-    double dist = 0.;
-    for (size_t i = 0; i < N; i++)
+    result[0] = target[0];
+    result[1] = target[1];
+    return program.run_scored(result, target.data(), target.size(), limit);
+}
+
+// The same in another arithmetic domain, see arithmetic.h, from the first
+// `seeds` terms of the target; UINT64_MAX for a program the domain
+// rejects.
+template <class Arithmetic = SearchArithmetic>
+uint64_t calculate_error_in(const Program &program, SequenceView target, typename Arithmetic::value_type *result,
+    uint64_t limit = UINT64_MAX, size_t seeds = 2)
+{
+    for (size_t i = 0; i < seeds; i++)
+    {
+        result[i] = Arithmetic::from_int(target[i]);
+    }
+    return program.run_scored_in<Arithmetic>(result, target.data(), target.size(), limit, seeds);
+}
+
+uint64_t squared_error(const int *lhs, const int *rhs, size_t count)
+{
+    uint64_t error = 0;
+    for (size_t i = 0; i < count; i++)
     {
-        dist += pow(lhs[i] - rhs[i], 2);
+        error = saturating_add(error, squared_diff(lhs[i], rhs[i]));
     }
-    dist = sqrt(dist);
-    return dist;
+    return error;
 }
 
 template <size_t N>
-unique_ptr<Node> dumb_random_search(const array <int, N> &target)
+uint64_t squared_error(const array<int, N> &lhs, const array<int, N> &rhs)
 {
-    array<int, N> result{};
-    unique_ptr<Node> root;
+    return squared_error(lhs.data(), rhs.data(), N);
+}
+
+
+// Only exact matches count, so a candidate is dropped at its first wrong
+// term.
+NodePtr dumb_random_search(SequenceView target)
+{
+    vector<int> result(target.size());
+    NodePtr root;
+    Program program;
     while (true)
     {
-        root.reset(generate_operations());
-        result = calculate<N>(root.get(), target[0], target[1]);
-        if (target == result)
+        root = generate_operations();
+        program.clear();
+        root->compile(program);
+        if (calculate_error(program, target, result.data(), 0) == 0)
         {
             break;
         }
@@ -372,22 +593,21 @@ unique_ptr<Node> dumb_random_search(const array <int, N> &target)
     return root;
 }
 
-void mutate(unique_ptr<Node> &root)
+void mutate(NodePtr &root, const LeafChoice &leaves = default_leaves())
 {
     int sz = root->size();
     int mut_ind = getRand(0, sz-1);
     if (mut_ind == 0)
     {
-        root.reset(generate_operations());
+        root = generate_operations(leaves);
     }
     else
     {
-        //TODO: change to taking NodePtr
-        root->mutate(mut_ind, generate_operations);
+        root = root->replace(mut_ind, generate_operations(leaves));
     }
 }
 
-NodePtr hybridise(NodePtr p0, NodePtr p1)
+NodePtr hybridise(const Node *p0, const Node *p1)
 {
     int sz0 = p0->size();
     int sz1 = p1->size();
@@ -395,15 +615,7 @@ NodePtr hybridise(NodePtr p0, NodePtr p1)
     int get_node = getRand(0, sz0-1);
     int set_node = getRand(0, sz1-1);
 
-    NodePtr node = nullptr;
-    if (get_node == 0)
-    {
-        node = p0->getCopy();
-    }
-    else
-    {
-        node = p0->getByIndex(get_node)->getCopy();
-    }
+    NodePtr node(p0->getByIndex(get_node));
 
     if (set_node == 0)
     {
@@ -411,151 +623,2695 @@ NodePtr hybridise(NodePtr p0, NodePtr p1)
     }
     else
     {
-        NodePtr result_node = p1->getCopy();
-        result_node->mutate(set_node, [node] {return node; });
-        return result_node;
+        return p1->replace(set_node, node);
     }
 
 }
 
-template <size_t N>
-unique_ptr<Node> mutating_search(const array <int, N> &target)
-{
-    unique_ptr<Node> winner = nullptr;
-    array<int, N> result {};
-    constexpr size_t gens_number = 256;
-    array<unique_ptr<Node>, gens_number> gens_b0, gens_b1, *gens, *new_gens;
-    array<pair<double,size_t>, gens_number> distances;
-
-    constexpr size_t elite = gens_number / 4; //-V112
-    constexpr size_t parents = gens_number / 8;
-    constexpr size_t children = gens_number / 4; //-V112
-    constexpr size_t new_ones = gens_number - elite - children;
+constexpr size_t default_population_size = 256;
+// Best individuals carried over to the next generation unchanged.
+constexpr size_t default_elite_size = default_population_size / 4; //-V112
+using Population = vector<NodePtr>;
+using Ranking = vector<pair<double, size_t>>;
 
-    constexpr int max_nodes_number = 30;
+struct SearchConfig
+{
+    // Individuals used this many times in a row, cache hits included, are
+    // compiled to native code; 0 keeps everything on the batched
+    // interpreter. Off by default: with the fitness cache on, the
+    // individuals that last are scored from the cache and not run, and
+    // bench-jit shows the search slower with the JIT than without.
+    unsigned jit_threshold = 0;
+    // Gives up after this many generations; 0 runs until a winner is
+    // found or another bound below ends the search.
+    size_t max_generations = 0;
+    // Budgets in wall time since the search started and in individuals
+    // evaluated, 0 for none. Like the cancel token they are checked once a
+    // generation, so a search overruns them by at most one generation.
+    size_t max_millis = 0;
+    uint64_t max_evaluations = 0;
+    CancelToken cancel;
+    // Called on the search thread each time the best individual improves,
+    // the winner included, with its squared error.
+    function<void(const NodePtr &best, uint64_t error, size_t generation)> on_improvement;
+    // Seed of the search; 0 takes the next one derived from the global
+    // seed. A search is reproducible from its seed with any pool size.
+    uint64_t seed = 0;
+    // Workers for evaluation and breeding; nullptr runs the search on the
+    // calling thread alone. A pool runs one search at a time.
+    ThreadPool *pool = nullptr;
+    // Where the search makes its trees, the ones it returns included;
+    // nullptr for the store of the process.
+    NodeStore *nodes = nullptr;
+    // Individuals per generation, the best of them carried over unchanged,
+    // and the nodes past which a tree is regrown from scratch. A quarter
+    // of the population are children of an eighth of it; the elite and
+    // the children must leave room for at least one fresh individual.
+    size_t population_size = default_population_size;
+    size_t elite_size = default_elite_size;
+    size_t max_nodes = 30;
+    // Terms back a formula may read, 2 being XPP. Past 2 the search also
+    // draws the lags up to that many terms back, XP3 for [n - 3], and
+    // every individual starts from that many terms of the target; with
+    // `prefix_sum` it also draws SUM, the sum of the terms so far. Either
+    // one runs every individual on the interpreter, not batched nor
+    // compiled, and keeps the search out of the solution store.
+    size_t lookback = 2;
+    bool prefix_sum = false;
+    VariableWeights variable_weights;
+    // How parents are picked, see selection.h. The ranking passed to
+    // on_generation is only in order over the elite.
+    SelectionMode selection = SelectionMode::truncation;
+    unsigned tournament_size = 4;
+
+    // Reuses the scores of trees seen in recent generations and ranks
+    // last the individuals that compute the same sequence as another one
+    // in the population, so breeding replaces them with fresh ones.
+    bool fitness_cache = true;
+    // The cache counters of the search are added here if not null.
+    FitnessCache::Stats *cache_stats = nullptr;
+
+    // Evaluates individuals in simplified form, see Program::simplify_in.
+    // The trees themselves stay as bred; only those the fitness cache
+    // does not know are compiled and simplified. Off by default: on an
+    // 8-term target the pass costs more than the evaluation it saves,
+    // bench-simplify shows both sides.
+    bool simplify = false;
+    // Nodes simplification took out of evaluated programs are added here
+    // if not null.
+    uint64_t *removed_nodes = nullptr;
+    // Generations run and individuals evaluated, rather than answered by
+    // the fitness cache, are added here if not null.
+    uint64_t *generations = nullptr;
+    uint64_t *evaluations = nullptr;
+
+    // Gets a TelemetryRow every `telemetry_interval` generations, see
+    // telemetry.h. Builds without SEQGEN_TELEMETRY ignore it.
+    TelemetrySink telemetry;
+    size_t telemetry_interval = 100;
+
+    // Every `checkpoint_interval` generations the state of the search is
+    // written to this file in the background, see checkpoint.h.
+    string checkpoint_path;
+    size_t checkpoint_interval = 100;
+    // Sequences solved before, see solution_store.h. A stored formula that
+    // computes the target is returned without searching; formulas of
+    // sequences sharing a prefix with it join the first population, and
+    // the winner is added.
+    SolutionStore *store = nullptr;
+    // Trees the first population starts with in place of random ones.
+    vector<NodePtr> seeds;
+
+    // Goes on with the search saved in this checkpoint instead of starting
+    // a new one. The seed comes from the file and the target must be the
+    // saved one; the search then ends as it would have without stopping,
+    // with any pool size.
+    string resume_path;
+
+    // Called every generation with the population and its ranking, best
+    // first, before the next generation is bred. It may replace
+    // individuals; returning false ends the search without a winner.
+    function<bool(size_t generation, Population &gens, const Ranking &ranking)> on_generation;
+};
 
-    gens = &gens_b0;
-    new_gens = &gens_b1;
+// How a search ended. Without a winner `best` is the closest individual
+// the search saw, nullptr only if it never finished a generation.
+struct SearchResult
+{
+    NodePtr best;
+    uint64_t error = UINT64_MAX;
+    SearchStop stop = SearchStop::generations;
+    uint64_t generations = 0;
 
-    for_each(begin(*gens), end(*gens), [](auto &genPtr) { genPtr.reset(generate_operations()); });
+    bool solved() const noexcept { return stop == SearchStop::solved; }
+};
 
-    while (true)
+// Inverse of Node::encode, for a run seeded with `lookback` terms that
+// keeps the prefix sum or not: a tree reading further back, or a sum the
+// run does not have, is rejected like one nested deeper than `max_depth`,
+// as a corrupt file.
+NodePtr decode_tree(ByteReader &in, NodeStore &store, size_t lookback, bool prefix_sum, int max_depth = 1000)
+{
+    if (max_depth == 0)
     {
-        for_each(begin(*gens), end(*gens), [max_nodes_number](auto &genPtr) {
-            if ( genPtr->size() > max_nodes_number )
-            {
-                genPtr.reset(generate_operations());
-            }
-        });
-
-        for (size_t i = 0; i < gens->size(); ++i)
-        {
-            auto &gen = (*gens)[i];
-            result = calculate<N>(gen.get(), target[0], target[1]);
-            double m_distance = distance(result, target);
-            distances[i] = make_pair(m_distance, i);
-            if (m_distance <= 2.)
-            {
-                winner = move(gen);
-                return winner;
-            }
-        }
-
-        std::sort(begin(distances), end(distances), [](const auto &l, const auto &r) {
-            return l.first < r.first;
-        });
-        size_t i = 0;
-        for (; i < children; i++)
-        {
-            size_t parent0_index = (size_t)getRand<0, parents-1>();
-            size_t parent1_index = (size_t)getRand<0, parents-1>();
-            auto newGen = unique_ptr<Node>(hybridise((*gens)[distances[parent0_index].second].get(), (*gens)[distances[parent1_index].second].get()));
-            mutate(newGen);
-            (*new_gens)[i] = move(newGen);
-        }
-        for (size_t j = 0; i < elite+children; i++, j++)
+        throw runtime_error("checkpoint: tree too deep");
+    }
+    const uint8_t byte = in.get_u8();
+    if (byte >= checkpoint_format::small_constant)
+    {
+        return store.make<Value>(byte - checkpoint_format::small_constant);
+    }
+    if (byte == checkpoint_format::any_constant)
+    {
+        return store.make<Value>((int)in.get_varint());
+    }
+    if (byte == checkpoint_format::lag)
+    {
+        const int64_t lag = in.get_varint();
+        if (lag < 1 || lag > (int64_t)lookback)
         {
-            (*new_gens)[i] = move((*gens)[distances[j].second]);
+            throw runtime_error("checkpoint: lag out of range");
         }
-        for (; i < new_ones+elite+children; i++)
+        return store.make<Variable>(VariableType::Lag, (unsigned)lag);
+    }
+    if (byte == checkpoint_format::sum)
+    {
+        if (!prefix_sum)
         {
-            (*new_gens)[i] = unique_ptr<Node>(generate_operations());
+            throw runtime_error("checkpoint: prefix sum of a run without one");
         }
-        swap(gens, new_gens);
+        return store.make<Variable>(VariableType::Sum);
+    }
+    if (byte >= checkpoint_format::variable)
+    {
+        return store.make<Variable>((VariableType)(byte - checkpoint_format::variable));
     }
+    NodePtr first = decode_tree(in, store, lookback, prefix_sum, max_depth - 1);
+    NodePtr second = decode_tree(in, store, lookback, prefix_sum, max_depth - 1);
+    return store.make<Operation>((OperationType)byte, make_pair(move(first), move(second)));
 }
 
-template <size_t N>
-void logOperations(ostream &strm, size_t millisecs, const unique_ptr<Node> &root, const array<int, N> &target)
+// What a search needs to go on from the start of `generation` as if it had
+// never stopped. The RNG needs only the seed: every individual built
+// draws from a stream seeded with it, the generation and its index.
+struct SearchCheckpoint
 {
-    strm << "Function: " << endl;
-    root->print(strm);
-    strm << endl;
+    uint64_t seed = 0;
+    uint64_t generation = 0;
+    uint64_t error_limit = UINT64_MAX;
+    uint32_t lookback = 2;
+    bool prefix_sum = false;
+    vector<int> target;
+    vector<NodePtr> population;
+    unsigned cache_generation = 0;
+    unordered_map<uint64_t, FitnessCache::Entry> cache;
+};
 
-    array<int, N> result{};
-    result = calculate<N>(root.get(), target[0], target[1]);
-    
-    strm << "Target: ";
-    for (const auto& elem : target)
+vector<uint8_t> encode_checkpoint(const SearchCheckpoint &checkpoint)
+{
+    ByteWriter out;
+    out.put_u32(checkpoint_format::magic);
+    out.put_u32(checkpoint_format::version);
+    out.put_u64(checkpoint.seed);
+    out.put_u64(checkpoint.generation);
+    out.put_u64(checkpoint.error_limit);
+    out.put_u32(checkpoint.lookback);
+    out.put_u8(checkpoint.prefix_sum ? 1 : 0);
+    out.put_u32((uint32_t)checkpoint.target.size());
+    for (int term : checkpoint.target)
     {
-        strm << elem << " ";
+        out.put_i32(term);
     }
-    strm << endl;
-
-    strm << "Result: ";
-    for (const auto& elem : result)
+    out.put_u32((uint32_t)checkpoint.population.size());
+    for (const NodePtr &tree : checkpoint.population)
     {
-        strm << elem << " ";
+        tree->encode(out);
     }
-    strm << endl;
-
-    strm << "Time: " << millisecs << " milliseconds" << endl << endl; //-V128
+    out.put_u32(checkpoint.cache_generation);
+    out.put_u64(checkpoint.cache.size());
+    for (const auto &entry : checkpoint.cache)
+    {
+        out.put_u64(entry.first);
+        out.put_u64(entry.second.error);
+        out.put_u64(entry.second.fingerprint);
+        out.put_u32(entry.second.last_seen);
+    }
+    out.put_u64(checkpoint_format::fnv1a(out.bytes().data(), out.bytes().size()));
+    return move(out.bytes());
 }
 
-void measure(int n = 100)
+// Throws runtime_error if the file is not a checkpoint or is damaged.
+SearchCheckpoint load_checkpoint(const string &path, NodeStore &store = NodeStore::instance())
 {
-    ofstream logfile("measure.txt", ios_base::app);
+    MappedFile file(path);
+    if (file.size() < 16 || checkpoint_format::fnv1a(file.data(), file.size() - 8) != ByteReader(file.data() + file.size() - 8, 8).get_u64())
+    {
+        throw runtime_error("checkpoint: " + path + " is damaged");
+    }
+    ByteReader in(file.data(), file.size() - 8);
+    if (in.get_u32() != checkpoint_format::magic || in.get_u32() != checkpoint_format::version)
+    {
+        throw runtime_error("checkpoint: " + path + " is not a checkpoint of this version");
+    }
+    SearchCheckpoint checkpoint;
+    checkpoint.seed = in.get_u64();
+    checkpoint.generation = in.get_u64();
+    checkpoint.error_limit = in.get_u64();
+    checkpoint.lookback = in.get_u32();
+    checkpoint.prefix_sum = in.get_u8() != 0;
+    if (checkpoint.lookback < 2 || checkpoint.lookback > max_lookback)
+    {
+        throw runtime_error("checkpoint: " + path + " is damaged");
+    }
+    checkpoint.target.resize(in.get_u32());
+    for (int &term : checkpoint.target)
+    {
+        term = in.get_i32();
+    }
+    checkpoint.population.resize(in.get_u32());
+    for (NodePtr &tree : checkpoint.population)
+    {
+        tree = decode_tree(in, store, checkpoint.lookback, checkpoint.prefix_sum);
+    }
+    checkpoint.cache_generation = in.get_u32();
+    const uint64_t entries = in.get_u64();
+    checkpoint.cache.reserve(min<uint64_t>(entries, in.remaining() / 28));
+    for (uint64_t i = 0; i < entries; i++)
+    {
+        const uint64_t key = in.get_u64();
+        FitnessCache::Entry &entry = checkpoint.cache[key];
+        entry.error = in.get_u64();
+        entry.fingerprint = in.get_u64();
+        entry.last_seen = in.get_u32();
+    }
+    return checkpoint;
+}
 
-    logfile << "Count: " << n << endl << endl;
+// N is the length of the target, or 0 for any length: the fixed ones let
+// the compiler unroll the loops over the terms. mutating_search picks one.
+template <size_t N>
+SearchResult mutating_search_of_length(SequenceView target, const SearchConfig &config)
+{
+    const size_t length = N != 0 ? N : target.size();
+    const Deadline deadline = config.max_millis != 0 ? Deadline::after(chrono::milliseconds(config.max_millis)) : Deadline();
+    SearchResult result;
+    const size_t gens_number = config.population_size;
+    Population gens_b0(gens_number), gens_b1(gens_number), *gens, *new_gens;
+    Ranking distances(gens_number);
+    vector<Program> programs(gens_number);
+    vector<uint64_t> errors(gens_number);
+    vector<uint64_t> keys(gens_number);
+    vector<uint64_t> fingerprints(gens_number);
+    vector<bool> cached(gens_number);
+    vector<const JitFunction*> native(gens_number);
+    vector<pair<uint64_t, size_t>> order;
+    JitCache jit(config.jit_threshold);
+    FitnessCache cache;
+    // Output fingerprint to the tree that first produced it.
+    unordered_map<uint64_t, uint64_t> seen_outputs;
+    seen_outputs.reserve(2 * gens_number);
+
+    ThreadPool inline_pool(1);
+    ThreadPool &pool = config.pool != nullptr ? *config.pool : inline_pool;
+    NodeStore &nodes = config.nodes != nullptr ? *config.nodes : NodeStore::instance();
+    SearchCheckpoint resumed;
+    if (!config.resume_path.empty())
+    {
+        resumed = load_checkpoint(config.resume_path, nodes);
+        if (resumed.target != vector<int>(target.begin(), target.end()) || resumed.population.size() != gens_number ||
+            resumed.lookback != config.lookback || resumed.prefix_sum != config.prefix_sum)
+        {
+            throw runtime_error("checkpoint: " + config.resume_path + " is of another search");
+        }
+    }
+    const uint64_t seed = !config.resume_path.empty() ? resumed.seed : config.seed != 0 ? config.seed : next_search_seed();
+    // Each individual built in a parallel phase draws from its own stream.
+    enum Phase { initial, regrow, breed, phases };
+    auto stream = [seed, gens_number](size_t generation, Phase phase, size_t i) {
+        seed_thread_rng(seed, (generation * phases + phase) * gens_number + i);
+    };
+    vector<BatchEvaluator> evaluators(pool.size());
+    vector<vector<const Program*>> batches(pool.size());
+    vector<vector<size_t>> batch_indices(pool.size());
+    vector<vector<uint64_t>> batch_errors(pool.size());
+    vector<vector<uint64_t>> batch_fingerprints(pool.size());
+    vector<vector<int>> results(pool.size(), vector<int>(length));
+    // Only the interpreter runs the other arithmetic domains, and the
+    // variables past XPP.
+    constexpr bool wrapping = is_same<SearchArithmetic, WrappingArithmetic>::value;
+    const LeafChoice leaves(nodes, config.lookback, config.prefix_sum, config.variable_weights);
+    const size_t seeds = config.lookback;
+    const bool interpreted = !wrapping || seeds > 2 || config.prefix_sum;
+    vector<vector<SearchArithmetic::value_type>> domain_results(interpreted ? pool.size() : 0,
+        vector<SearchArithmetic::value_type>(length));
+    // Nodes simplification took out, per worker.
+    vector<uint64_t> removed(pool.size());
+    uint64_t generations = 0;
+    uint64_t evaluations = 0;
+    TelemetryRecorder telemetry(config.telemetry, config.telemetry_interval, pool.size(), seed,
+        [&nodes] {
+            const NodeStore::Stats stats = nodes.stats();
+            return stats.lookups - stats.shared;
+        });
 
-    logfile << "Mutating search" << endl << endl;
+    auto report = [&config, &cache, &removed, &generations, &evaluations] {
+        if (config.cache_stats != nullptr)
+        {
+            *config.cache_stats += cache.stats();
+        }
+        if (config.removed_nodes != nullptr)
+        {
+            *config.removed_nodes += accumulate(removed.begin(), removed.end(), (uint64_t)0);
+        }
+        if (config.generations != nullptr)
+        {
+            *config.generations += generations;
+        }
+        if (config.evaluations != nullptr)
+        {
+            *config.evaluations += evaluations;
+        }
+    };
+    auto finish = [&report, &result, &generations](SearchStop stop) {
+        report();
+        result.stop = stop;
+        result.generations = generations;
+        return move(result);
+    };
+    auto improve = [&config, &result](NodePtr best, uint64_t error, size_t generation) {
+        result.best = move(best);
+        result.error = error;
+        if (config.on_improvement)
+        {
+            config.on_improvement(result.best, error, generation);
+        }
+    };
 
-    size_t total = 0;
+    constexpr size_t grain = 16;
 
-    constexpr array<int, 8> target{ 0, 4, 30, 120, 340, 780, 1554, 2800 };
+    const size_t elite = config.elite_size;
+    const size_t parents = gens_number / 8;
+    const size_t children = gens_number / 4; //-V112
 
-    for (int i = 0; i < n; i++)
-    {
-        auto t_start = chrono::high_resolution_clock::now();
-        auto root = mutating_search(target);
-        auto t_end = chrono::high_resolution_clock::now();
-        auto millisecs = chrono::duration_cast<chrono::milliseconds>(t_end - t_start);
-        total += millisecs.count();
-        logOperations(cout, (size_t)millisecs.count(), root, target);
-        logOperations(logfile, (size_t)millisecs.count(), root, target);
-    }
+    const int max_nodes_number = (int)config.max_nodes;
 
-    logfile << endl << "Total: " << total << endl; //-V128
+    Selector selector(config.selection, elite, parents, config.tournament_size);
 
+    gens = &gens_b0;
+    new_gens = &gens_b1;
 
-    total = 0;
+    // Error of the worst elite individual of the previous generation. The
+    // elite comes back unchanged, so anything worse ranks below it whatever
+    // its exact error is, and its evaluation stops there.
+    uint64_t error_limit = UINT64_MAX;
 
-    for (int i = 0; i < n; i++)
+    size_t first_generation = 0;
+    if (config.resume_path.empty())
     {
-        auto t_start = chrono::high_resolution_clock::now();
-        auto root = dumb_random_search(target);
-        auto t_end = chrono::high_resolution_clock::now();
-        auto millisecs = chrono::duration_cast<chrono::milliseconds>(t_end - t_start);
-        total += millisecs.count();
-        logOperations(cout, (size_t)millisecs.count(), root, target);
-        logOperations(logfile, (size_t)millisecs.count(), root, target);
-    }
+        pool.parallel_for(gens_number, grain, [gens, &stream, &leaves](size_t, size_t first, size_t last) {
+            for (size_t i = first; i < last; i++)
+            {
+                stream(0, initial, i);
+                (*gens)[i] = generate_operations(leaves);
+            }
+        });
+        copy_n(config.seeds.begin(), min(config.seeds.size(), gens_number), gens->begin());
+    }
+    else
+    {
+        move(resumed.population.begin(), resumed.population.end(), gens->begin());
+        first_generation = resumed.generation;
+        error_limit = resumed.error_limit;
+        cache.restore(resumed.cache_generation, move(resumed.cache));
+    }
+    unique_ptr<CheckpointWriter> checkpoints;
+    if (!config.checkpoint_path.empty())
+    {
+        checkpoints.reset(new CheckpointWriter());
+    }
+
+    for (size_t generation = first_generation; config.max_generations == 0 || generation < config.max_generations; generation++)
+    {
+        generations++;
+        telemetry.start_generation();
+        pool.parallel_for(gens_number, grain, [&](size_t worker, size_t first, size_t last) {
+            for (size_t i = first; i < last; i++)
+            {
+                auto &genPtr = (*gens)[i];
+                if ( genPtr->size() > max_nodes_number )
+                {
+                    stream(generation, regrow, i);
+                    genPtr = generate_operations(leaves);
+                    telemetry.count_reset(worker);
+                }
+                keys[i] = genPtr->hash();
+                // Only what the cache does not know is compiled.
+                if (config.fitness_cache && cache.contains(keys[i]))
+                {
+                    continue;
+                }
+                programs[i].clear();
+                genPtr->compile(programs[i]);
+                if (config.simplify)
+                {
+                    const size_t size = programs[i].size();
+                    programs[i].simplify_in<SearchArithmetic>();
+                    removed[worker] += size - programs[i].size();
+                }
+            }
+        });
+        telemetry.end_phase(TelemetryRecorder::compile);
+
+
+        // Native individuals go last; the rest are ordered by shape so
+        // that a chunk of them fills whole SIMD batches. Cached ones are
+        // not evaluated at all.
+        order.clear();
+        for (size_t i = 0; i < gens_number; ++i)
+        {
+            const FitnessCache::Entry *entry = config.fitness_cache ? cache.find(keys[i]) : nullptr;
+            cached[i] = entry != nullptr;
+            if (cached[i])
+            {
+                errors[i] = entry->error;
+                fingerprints[i] = entry->fingerprint;
+                // Still a use: it is compiled once the cache lets it go.
+                if (!interpreted)
+                {
+                    jit.touch(keys[i]);
+                }
+                continue;
+            }
+            native[i] = interpreted ? nullptr : jit.lookup(programs[i], keys[i]);
+            order.emplace_back(native[i] != nullptr ? UINT64_MAX : simd_detail::shape_key(programs[i]), i);
+        }
+        jit.next_generation();
+        cache.next_generation();
+        sort(order.begin(), order.end());
+        evaluations += order.size();
+        telemetry.count_evaluations(order.size());
+
+        pool.parallel_for(order.size(), grain, [&](size_t worker, size_t first, size_t last) {
+            if (interpreted)
+            {
+                SearchArithmetic::value_type *const result = domain_results[worker].data();
+                for (size_t k = first; k < last; k++)
+                {
+                    const size_t i = order[k].second;
+                    errors[i] = calculate_error_in(programs[i], target, result, error_limit, seeds);
+                    // Rejected candidates all look alike; keep them apart.
+                    fingerprints[i] = errors[i] > error_limit || errors[i] == UINT64_MAX ? keys[i]
+                        : output_fingerprint_of(result, length);
+                }
+                return;
+            }
+            vector<const Program*> &batch = batches[worker];
+            vector<size_t> &batch_index = batch_indices[worker];
+            batch.clear();
+            batch_index.clear();
+            int *const result = results[worker].data();
+            for (size_t k = first; k < last; k++)
+            {
+                const size_t i = order[k].second;
+                if (native[i] != nullptr)
+                {
+                    result[0] = target[0];
+                    result[1] = target[1];
+                    native[i]->run_sequence(result, length);
+                    errors[i] = squared_error(result, target.data(), length);
+                    fingerprints[i] = output_fingerprint(result, length);
+                }
+                else
+                {
+                    batch.push_back(&programs[i]);
+                    batch_index.push_back(i);
+                }
+            }
+            batch_errors[worker].resize(batch.size());
+            batch_fingerprints[worker].resize(batch.size());
+            evaluators[worker].evaluate(batch, target.data(), length, batch_errors[worker].data(), batch_fingerprints[worker].data(), error_limit);
+            for (size_t k = 0; k < batch.size(); ++k)
+            {
+                const size_t i = batch_index[k];
+                errors[i] = batch_errors[worker][k];
+                // A partial fingerprint says nothing about the output, the
+                // tree itself is the only safe key then.
+                fingerprints[i] = errors[i] > error_limit ? keys[i] : batch_fingerprints[worker][k];
+            }
+        });
+        telemetry.end_phase(TelemetryRecorder::evaluate);
+
+        // Scanned in index order after all workers are done, so the winner
+        // does not depend on which thread finished first. Of the
+        // individuals computing the same sequence only the first keeps its
+        // rank; the others are bred out in favour of fresh individuals.
+        seen_outputs.clear();
+        for (size_t i = 0; i < gens->size(); ++i)
+        {
+            distances[i] = make_pair(sqrt((double)errors[i]), i);
+            if (errors[i] <= 4)
+            {
+                // Ranked as far as the scan got, which is the solution.
+                telemetry.finish(generation, *gens, Ranking(distances.begin(), distances.begin() + i + 1));
+                improve(move((*gens)[i]), errors[i], generation);
+                return finish(SearchStop::solved);
+            }
+            if (!config.fitness_cache)
+            {
+                continue;
+            }
+            if (!cached[i] && errors[i] <= error_limit)
+            {
+                cache.insert(keys[i], errors[i], fingerprints[i]);
+            }
+            auto seen = seen_outputs.emplace(fingerprints[i], keys[i]);
+            if (!seen.second)
+            {
+                distances[i].first = numeric_limits<double>::infinity();
+                if (seen.first->second == keys[i])
+                {
+                    cache.stats().duplicates++;
+                }
+                else
+                {
+                    cache.stats().semantic_duplicates++;
+                }
+            }
+        }
+
+        selector.rank(distances.data(), distances.data() + distances.size());
+        // Unless duplicates reach into the elite: those are bred out.
+        error_limit = isinf(distances[elite - 1].first) ? UINT64_MAX : errors[distances[elite - 1].second];
+        // The best is no worse than the elite carried over, so its error
+        // is exact and not cut short at the previous error limit.
+        const size_t best = distances[0].second;
+        if (errors[best] < result.error)
+        {
+            improve((*gens)[best], errors[best], generation);
+        }
+        SearchStop stop = SearchStop::generations;
+        if (config.on_generation && !config.on_generation(generation, *gens, distances))
+        {
+            stop = SearchStop::hook;
+        }
+        else if (config.cancel.cancelled())
+        {
+            stop = SearchStop::cancelled;
+        }
+        else if (config.max_evaluations != 0 && evaluations >= config.max_evaluations)
+        {
+            stop = SearchStop::evaluations;
+        }
+        else if (deadline.expired())
+        {
+            stop = SearchStop::deadline;
+        }
+        if (stop != SearchStop::generations)
+        {
+            telemetry.finish(generation, *gens, distances);
+            return finish(stop);
+        }
+        telemetry.end_phase(TelemetryRecorder::rank);
+
+        // Children share everything but the rebuilt paths with their
+        // parents, and the elite is carried over by reference.
+        pool.parallel_for(gens_number, grain, [&](size_t, size_t first, size_t last) {
+            for (size_t slot = first; slot < last; slot++)
+            {
+                if (slot < children)
+                {
+                    stream(generation, breed, slot);
+                    size_t parent0_index = selector.pick();
+                    size_t parent1_index = selector.pick();
+                    auto newGen = hybridise((*gens)[distances[parent0_index].second].get(), (*gens)[distances[parent1_index].second].get());
+                    mutate(newGen, leaves);
+                    (*new_gens)[slot] = move(newGen);
+                }
+                else if (slot < children + elite)
+                {
+                    (*new_gens)[slot] = (*gens)[distances[slot - children].second];
+                }
+                else
+                {
+                    stream(generation, breed, slot - elite);
+                    (*new_gens)[slot] = generate_operations(leaves);
+                }
+            }
+        });
+        telemetry.end_phase(TelemetryRecorder::breed);
+        telemetry.end_generation(generation, *gens, distances);
+        swap(gens, new_gens);
+
+        // The trees are immutable and shared, so the snapshot takes
+        // references to them and the writer thread encodes them.
+        if (checkpoints && (generation + 1) % max<size_t>(config.checkpoint_interval, 1) == 0 && !checkpoints->busy())
+        {
+            auto checkpoint = make_shared<SearchCheckpoint>();
+            checkpoint->seed = seed;
+            checkpoint->generation = generation + 1;
+            checkpoint->error_limit = error_limit;
+            checkpoint->lookback = (uint32_t)config.lookback;
+            checkpoint->prefix_sum = config.prefix_sum;
+            checkpoint->target.assign(target.begin(), target.end());
+            checkpoint->population.assign(gens->begin(), gens->end());
+            checkpoint->cache_generation = cache.generation();
+            checkpoint->cache = cache.entries();
+            checkpoints->submit(config.checkpoint_path, [checkpoint] { return encode_checkpoint(*checkpoint); });
+        }
+    }
+    // The swap took the last generation ranked in `distances` to `new_gens`.
+    telemetry.finish(first_generation + (size_t)generations - 1, *new_gens, distances);
+    return finish(SearchStop::generations);
+}
+
+// Target lengths with a search compiled for them; the others, longer or
+// shorter, share the one for any length.
+constexpr size_t min_fixed_length = 4;
+constexpr size_t max_fixed_length = 32;
+
+using SearchFunction = SearchResult (*)(SequenceView, const SearchConfig&);
+
+template <size_t... Lengths>
+array<SearchFunction, sizeof...(Lengths)> make_search_table(index_sequence<Lengths...>)
+{
+    return { { &mutating_search_of_length<(Lengths >= min_fixed_length ? Lengths : 0)>... } };
+}
+
+vector<uint8_t> encode_tree(const NodePtr &root)
+{
+    ByteWriter out;
+    root->encode(out);
+    return move(out.bytes());
+}
+
+// A formula from the store that computes the target, checked against it
+// rather than trusted, or nullptr; the formulas that do not go to `near`.
+// Only formulas a run from two seed terms can evaluate are taken, like
+// the searches that consult the store.
+NodePtr recall_solution(const SolutionStore &store, SequenceView target, vector<NodePtr> &near, NodeStore &nodes)
+{
+    vector<SearchArithmetic::value_type> result(target.size());
+    Program program;
+    for (const SolutionStore::Match &match : store.lookup(target))
+    {
+        NodePtr tree;
+        try
+        {
+            ByteReader in(match.formula.data(), match.formula.size());
+            tree = decode_tree(in, nodes, 2, false);
+        }
+        catch (const runtime_error&)
+        {
+            continue;
+        }
+        program.clear();
+        tree->compile(program);
+        if (calculate_error_in(program, target, result.data()) <= 4)
+        {
+            return tree;
+        }
+        near.push_back(move(tree));
+    }
+    return nullptr;
+}
+
+// An eighth of the population are parents, so it takes at least 8; the
+// elite and the children, a quarter, leave room for fresh individuals.
+void check_population_shape(size_t population, size_t elite)
+{
+    if (population < 8 || elite == 0 || elite + population / 4 >= population)
+    {
+        throw invalid_argument("a population needs at least 8 individuals and room for fresh ones past the elite and the children");
+    }
+}
+
+// The target starts with the terms every individual is seeded with, two
+// or the lookback of the config, so it needs at least one more to say
+// anything about them. The search ends at a winner or at the first bound
+// of the config it reaches, and returns the best individual it saw
+// either way.
+SearchResult anytime_search(SequenceView target, const SearchConfig &config = SearchConfig())
+{
+    static const array<SearchFunction, max_fixed_length + 1> table = make_search_table(make_index_sequence<max_fixed_length + 1>());
+    if (target.size() < 3)
+    {
+        throw invalid_argument("a target needs at least 3 terms");
+    }
+    check_lookback(config.lookback);
+    if (target.size() <= config.lookback)
+    {
+        throw invalid_argument("a target needs more terms than the lookback");
+    }
+    check_population_shape(config.population_size, config.elite_size);
+    const SearchFunction search = target.size() < table.size() ? table[target.size()] : &mutating_search_of_length<0>;
+    // Stored formulas start from two terms.
+    if (config.store == nullptr || !config.resume_path.empty() || config.lookback > 2 || config.prefix_sum)
+    {
+        return search(target, config);
+    }
+    SearchConfig seeded = config;
+    if (NodePtr stored = recall_solution(*config.store, target, seeded.seeds,
+        config.nodes != nullptr ? *config.nodes : NodeStore::instance()))
+    {
+        vector<SearchArithmetic::value_type> result(target.size());
+        Program program;
+        stored->compile(program);
+        SearchResult recalled;
+        recalled.error = calculate_error_in(program, target, result.data());
+        recalled.best = move(stored);
+        recalled.stop = SearchStop::solved;
+        if (config.on_improvement)
+        {
+            config.on_improvement(recalled.best, recalled.error, 0);
+        }
+        return recalled;
+    }
+    SearchResult searched = search(target, seeded);
+    if (searched.solved())
+    {
+        config.store->insert(target, encode_tree(searched.best));
+    }
+    return searched;
+}
+
+// The winner, or nullptr if the search ended without one.
+NodePtr mutating_search(SequenceView target, const SearchConfig &config = SearchConfig())
+{
+    SearchResult result = anytime_search(target, config);
+    return result.solved() ? move(result.best) : nullptr;
+}
+
+// An anytime search running on a thread of its own. Its best individual
+// so far can be polled or waited for while it runs; cancel() ends it at
+// the next generation, and so does the destructor, which waits for it.
+// Without a pool in the config the search gets one of its own with a
+// thread per hardware thread.
+class SearchHandle
+{
+public:
+    struct Best
+    {
+        NodePtr tree;
+        uint64_t error = UINT64_MAX;
+        size_t generation = 0;
+    };
+
+    SearchHandle(SequenceView target, SearchConfig config) : target_(target.begin(), target.end()), cancel_(config.cancel)
+    {
+        if (config.pool == nullptr)
+        {
+            pool_.reset(new ThreadPool());
+            config.pool = pool_.get();
+        }
+        auto on_improvement = move(config.on_improvement);
+        config.on_improvement = [this, on_improvement](const NodePtr &tree, uint64_t error, size_t generation) {
+            best_.publish(Best{ tree, error, generation });
+            if (on_improvement)
+            {
+                on_improvement(tree, error, generation);
+            }
+        };
+        thread_ = thread([this, config] {
+            try
+            {
+                result_ = anytime_search(target_, config);
+            }
+            catch (...)
+            {
+                error_ = current_exception();
+            }
+            best_.close();
+        });
+    }
+
+    SearchHandle(const SearchHandle&) = delete;
+    SearchHandle& operator=(const SearchHandle&) = delete;
+
+    ~SearchHandle()
+    {
+        cancel();
+        if (thread_.joinable())
+        {
+            thread_.join();
+        }
+    }
+
+    void cancel() const noexcept { cancel_.cancel(); }
+
+    // The best so far and its version, 0 while there is none yet.
+    uint64_t best(Best &best) const { return best_.get(best); }
+
+    // Waits at most `timeout` for a best newer than version `seen`;
+    // returns the version got, `seen` if none came.
+    template <class Rep, class Period>
+    uint64_t wait_better(uint64_t seen, Best &best, chrono::duration<Rep, Period> timeout) const
+    {
+        return best_.wait_newer(seen, best, timeout);
+    }
+
+    // Waits for the end of the search; rethrows what it threw.
+    SearchResult wait()
+    {
+        if (thread_.joinable())
+        {
+            thread_.join();
+        }
+        if (error_)
+        {
+            rethrow_exception(error_);
+        }
+        return result_;
+    }
+
+private:
+    vector<int> target_;
+    CancelToken cancel_;
+    unique_ptr<ThreadPool> pool_;
+    LatestValue<Best> best_;
+    SearchResult result_;
+    exception_ptr error_;
+    thread thread_;
+};
+
+// Inverse of Node::compile.
+NodePtr build_tree(const Program &program, NodeStore &store = NodeStore::instance())
+{
+    vector<NodePtr> stack;
+    for (const Instr &instr : program.code())
+    {
+        switch (instr.op)
+        {
+        case OpCode::Value:
+            stack.push_back(store.make<Value>(instr.arg));
+            break;
+        case OpCode::N:
+            stack.push_back(store.make<Variable>(VariableType::N));
+            break;
+        case OpCode::XP:
+            stack.push_back(store.make<Variable>(VariableType::XP));
+            break;
+        case OpCode::XPP:
+            stack.push_back(store.make<Variable>(VariableType::XPP));
+            break;
+        case OpCode::Lag:
+            stack.push_back(store.make<Variable>(VariableType::Lag, (unsigned)instr.arg));
+            break;
+        case OpCode::Sum:
+            stack.push_back(store.make<Variable>(VariableType::Sum));
+            break;
+        default:
+            {
+                NodePtr rhs = move(stack.back());
+                stack.pop_back();
+                NodePtr lhs = move(stack.back());
+                stack.pop_back();
+                const auto type = instr.op == OpCode::Plus ? OperationType::plus : instr.op == OpCode::Minus ? OperationType::minus : OperationType::mul;
+                stack.push_back(store.make<Operation>(type, make_pair(move(lhs), move(rhs))));
+            }
+            break;
+        }
+    }
+    return stack.back();
+}
+
+// The tree of the simplified program, in the arithmetic of the search,
+// see Program::simplify_in.
+NodePtr simplify(const NodePtr &root)
+{
+    Program program;
+    root->compile(program);
+    program.simplify_in<SearchArithmetic>();
+    return build_tree(program, NodeStore::of(root.get()));
+}
+
+// The tree as print() writes it, without the trailing space.
+string formula_string(const NodePtr &root)
+{
+    ostringstream strm;
+    root->print(strm);
+    string text = strm.str();
+    while (!text.empty() && text.back() == ' ')
+    {
+        text.pop_back();
+    }
+    return text;
+}
+
+struct EnumerativeConfig
+{
+    // Largest tree tried, in nodes.
+    size_t max_size = 15;
+    // Bytes the bank of distinct expressions may take. Past it the search
+    // goes on without keeping new ones, so it may miss a formula.
+    size_t memory_limit = size_t(256) << 20;
+    // Workers expanding each size; nullptr runs on the calling thread.
+    ThreadPool *pool = nullptr;
+    // Expressions built and distinct ones kept are added here if not null.
+    uint64_t *candidates = nullptr;
+    uint64_t *kept = nullptr;
+};
+
+NodePtr enumerated_tree(const BottomUpEnumerator &enumerator, const BottomUpEnumerator::Origin &origin, const vector<NodePtr> &leaves)
+{
+    if (origin.op == BottomUpEnumerator::leaf)
+    {
+        return leaves[origin.left];
+    }
+    return make_node<Operation>((OperationType)origin.op, make_pair(enumerated_tree(enumerator, enumerator.origin(origin.left), leaves),
+        enumerated_tree(enumerator, enumerator.origin(origin.right), leaves)));
+}
+
+// Exhaustive counterpart of dumb_random_search: the smallest tree giving
+// the target exactly, up to config.max_size nodes, or nullptr. See
+// enumerator.h.
+NodePtr enumerative_search(SequenceView target, const EnumerativeConfig &config = EnumerativeConfig())
+{
+    if (target.size() < 3)
+    {
+        throw invalid_argument("a target needs at least 3 terms");
+    }
+    const size_t points = target.size() - 2;
+    vector<NodePtr> leaves;
+    vector<vector<int>> leaf_values;
+    for (int i = 0; i < 10; i++)
+    {
+        leaves.push_back(make_node<Value>(i));
+        leaf_values.emplace_back(points, i);
+    }
+    leaves.push_back(make_node<Variable>(VariableType::N));
+    leaves.push_back(make_node<Variable>(VariableType::XP));
+    leaves.push_back(make_node<Variable>(VariableType::XPP));
+    leaf_values.resize(leaves.size(), vector<int>(points));
+    for (size_t i = 0; i < points; i++)
+    {
+        leaf_values[10][i] = (int)(i + 3);
+        leaf_values[11][i] = target[i + 1];
+        leaf_values[12][i] = target[i];
+    }
+
+    BottomUpEnumerator enumerator(move(leaf_values), vector<int>(target.begin() + 2, target.end()), config.memory_limit);
+    ThreadPool inline_pool(1);
+    const bool found = enumerator.run(config.max_size, config.pool != nullptr ? *config.pool : inline_pool);
+    if (config.candidates != nullptr)
+    {
+        *config.candidates += enumerator.candidates();
+    }
+    if (config.kept != nullptr)
+    {
+        *config.kept += enumerator.bank_size();
+    }
+    return found ? enumerated_tree(enumerator, enumerator.match(), leaves) : nullptr;
+}
+
+struct Solver::State
+{
+    // Goes last, after the pool and every tree of the searches.
+    NodeStore nodes;
+    SolverOptions options;
+    ThreadPool pool;
+    uint64_t seed;
+    uint64_t solves = 0;
+
+    explicit State(const SolverOptions &options)
+        : options(options), pool(options.threads), seed(options.seed != 0 ? options.seed : random_device{}() | (uint64_t)random_device{}() << 32)
+    {
+    }
+};
+
+Solver::Solver(const SolverOptions &options)
+{
+    check_population_shape(options.population_size, options.elite_size);
+    check_lookback(options.lookback);
+    state_.reset(new State(options));
+}
+
+Solver::~Solver() = default;
+
+const SolverOptions& Solver::options() const noexcept
+{
+    return state_->options;
+}
+
+Solution Solver::solve(const vector<int> &target, const CancelToken &cancel,
+    const function<void(const string &formula, uint64_t error)> &on_improvement)
+{
+    const SolverOptions &options = state_->options;
+    Solution solution;
+    // Never 0, which would fall back to the process-wide seed sequence.
+    solution.seed = mix64(state_->seed + ++state_->solves) | 1;
+
+    SearchConfig config;
+    config.pool = &state_->pool;
+    config.nodes = &state_->nodes;
+    config.seed = solution.seed;
+    config.population_size = options.population_size;
+    config.elite_size = options.elite_size;
+    config.max_nodes = options.max_nodes;
+    config.lookback = options.lookback;
+    config.prefix_sum = options.prefix_sum;
+    config.jit_threshold = options.jit_threshold;
+    config.max_generations = options.max_generations;
+    config.max_millis = options.max_millis;
+    config.max_evaluations = options.max_evaluations;
+    config.cancel = cancel;
+    config.generations = &solution.generations;
+    config.evaluations = &solution.evaluations;
+    if (on_improvement)
+    {
+        config.on_improvement = [&on_improvement](const NodePtr &best, uint64_t error, size_t) {
+            on_improvement(formula_string(best), error);
+        };
+    }
+
+    const SearchResult result = anytime_search(target, config);
+    solution.stop = result.stop;
+    solution.error = result.error;
+    if (result.best)
+    {
+        solution.formula = formula_string(result.best);
+        solution.simplified = formula_string(simplify(result.best));
+    }
+    return solution;
+}
+
+#ifndef SEQGEN_LIBRARY
+
+// Everything below is the command line program: its defaults are set once
+// from the arguments before any search starts.
+
+// Reads `text`, what `name` was given on the command line, as a whole
+// number of at most `max`. Anything else is reported as an invalid value
+// for `name`, and main exits with 1.
+template <class T>
+bool parse_arg(const string &name, const string &text, T &value, T max = numeric_limits<T>::max())
+{
+    // stoull alone would take a sign, leading blanks and trailing junk.
+    bool valid = !text.empty() && all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; });
+    unsigned long long parsed = 0;
+    if (valid)
+    {
+        try
+        {
+            parsed = stoull(text);
+        }
+        catch (const out_of_range&)
+        {
+            valid = false;
+        }
+    }
+    if (!valid || parsed > (unsigned long long)max)
+    {
+        cerr << "invalid value for " << name << ": " << text << endl;
+        return false;
+    }
+    value = (T)parsed;
+    return true;
+}
+
+// Selection of searches that do not pick one; --selection=<mode> sets it.
+SelectionMode default_selection = SelectionMode::truncation;
+// Telemetry of searches that do not bring a sink; --telemetry=<file> sets
+// it.
+TelemetrySink default_telemetry;
+size_t default_telemetry_interval = 100;
+// Store searches look in and add to; --store=<file> opens one.
+SolutionStore *default_store = nullptr;
+
+// Shared by the searches of the program, one at a time, so worker
+// threads are started once per process.
+ThreadPool& search_pool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+// The defaults of the command line alone, for searches that bring their
+// own pool.
+SearchConfig cli_defaults()
+{
+    SearchConfig config;
+    config.selection = default_selection;
+    config.telemetry = default_telemetry;
+    config.telemetry_interval = default_telemetry_interval;
+    config.store = default_store;
+    return config;
+}
+
+// A search with the defaults of the command line.
+SearchConfig cli_search_config()
+{
+    SearchConfig config = cli_defaults();
+    config.pool = &search_pool();
+    return config;
+}
+
+// Runs `islands` populations in forked processes. Every `interval`
+// generations each island sends its best `migrants` to the next one and
+// puts what it received in place of its weakest elite. The first winner
+// stops all of them.
+NodePtr island_search(SequenceView target, size_t islands, size_t interval = 20, size_t migrants = 4)
+{
+    // The store is only ever touched here, never by an island: its lock
+    // and mapping are not shared between processes. The islands start
+    // from what it has near the target, and the winner goes into it.
+    vector<NodePtr> near;
+    if (default_store != nullptr)
+    {
+        if (NodePtr stored = recall_solution(*default_store, target, near, NodeStore::instance()))
+        {
+            return stored;
+        }
+    }
+
+    IslandShm shm(islands);
+    IslandState &state = shm.state();
+    const uint64_t seed = next_search_seed();
+
+    vector<pid_t> children;
+    for (size_t island = 0; island < islands; island++)
+    {
+        const pid_t pid = fork();
+        if (pid < 0)
+        {
+            break;
+        }
+        if (pid > 0)
+        {
+            children.push_back(pid);
+            continue;
+        }
+
+        // Not search_pool(): its threads would be started in every child.
+        ThreadPool pool(1);
+        SearchConfig config = cli_defaults();
+        config.pool = &pool;
+        config.store = nullptr;
+        config.seeds = near;
+        config.seed = mix64(seed + island);
+        config.on_generation = [&](size_t generation, Population &gens, const Ranking &ranking) {
+            if (state.stopped())
+            {
+                return false;
+            }
+            if (generation == 0 || generation % interval != 0)
+            {
+                return true;
+            }
+            Program program;
+            WireTree tree;
+            for (size_t j = 0; j < migrants; j++)
+            {
+                program.clear();
+                gens[ranking[j].second]->compile(program);
+                if (tree.pack(program))
+                {
+                    shm.outbox(island).push(tree);
+                }
+            }
+            // Weakest elites first, never past the elite.
+            const size_t room = min<size_t>(config.elite_size, MigrationRing::capacity);
+            for (size_t received = 0; received < room && shm.inbox(island).pop(tree); received++)
+            {
+                tree.unpack(program);
+                gens[ranking[config.elite_size - 1 - received].second] = build_tree(program);
+            }
+            return true;
+        };
+
+        auto winner = mutating_search(target, config);
+        if (winner)
+        {
+            Program program;
+            WireTree tree;
+            winner->compile(program);
+            if (tree.pack(program))
+            {
+                state.claim_win((int)island, tree);
+            }
+        }
+        _exit(0);
+    }
+
+    for (pid_t pid : children)
+    {
+        waitpid(pid, nullptr, 0);
+    }
+    if (!state.winner_ready.load(std::memory_order_acquire))
+    {
+        return nullptr;
+    }
+    Program program;
+    state.winner_tree.unpack(program);
+    NodePtr winner = build_tree(program);
+    if (default_store != nullptr)
+    {
+        default_store->insert(target, encode_tree(winner));
+    }
+    return winner;
+}
+
+// `seeds` is the number of terms the search started from, its lookback.
+void logOperations(ostream &strm, size_t millisecs, const NodePtr &root, SequenceView target, size_t seeds = 2)
+{
+    strm << "Function: " << endl;
+    root->print(strm);
+    strm << endl;
+    strm << "Simplified: " << endl;
+    simplify(root)->print(strm);
+    strm << endl;
+
+    // In the arithmetic the search ran in.
+    Program program;
+    root->compile(program);
+    vector<SearchArithmetic::value_type> result(target.size());
+    for (size_t i = 0; i < seeds; i++)
+    {
+        result[i] = SearchArithmetic::from_int(target[i]);
+    }
+    const bool complete = program.run_sequence_in<SearchArithmetic>(result.data(), result.size(), seeds);
+    
+    strm << "Target: ";
+    for (const auto& elem : target)
+    {
+        strm << elem << " ";
+    }
+    strm << endl;
+
+    strm << "Result: ";
+    if (complete)
+    {
+        for (const auto& elem : result)
+        {
+            strm << SearchArithmetic::to_string(elem) << " ";
+        }
+    }
+    else
+    {
+        strm << "overflows";
+    }
+    strm << endl;
+
+    strm << "Time: " << millisecs << " milliseconds" << endl << endl; //-V128
+}
+
+struct BatchConfig
+{
+    // Searches running at once, one thread each; 0 is one per hardware
+    // thread.
+    size_t jobs = 0;
+    // Budgets of each sequence, 0 for none. A sequence with no formula in
+    // reach only ends on one of them, and its line then has the closest
+    // formula found instead.
+    size_t max_generations = 0;
+    size_t max_millis = 10000;
+    uint64_t max_evaluations = 0;
+};
+
+string json_string(const string &text)
+{
+    static const char digits[] = "0123456789abcdef";
+    string quoted = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            quoted += '\\';
+            quoted += c;
+        }
+        else if ((unsigned char)c < 0x20)
+        {
+            quoted += "\\u00";
+            quoted += digits[c >> 4];
+            quoted += digits[c & 15];
+        }
+        else
+        {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+// Searches a formula for every sequence in `in` and writes one JSON object
+// per sequence to `out` as soon as its search ends, so the results come in
+// order of completion; "line" is where the sequence was in the input.
+//
+// A line holds the terms separated by commas and/or spaces, optionally
+// preceded by a name starting with a letter, as in OEIS's stripped file:
+//   A000290 ,0,1,4,9,16,25,36,49,
+// Blank lines and lines starting with # are skipped. Lines are read only
+// as workers become free, so memory does not grow with the input. Each
+// sequence has its own seed derived from the global one and its line, so
+// results do not depend on how the jobs are scheduled.
+void solve_batch(istream &in, ostream &out, const BatchConfig &config)
+{
+    struct Job
+    {
+        size_t line;
+        string name;
+        string terms;
+    };
+
+    const size_t jobs = config.jobs != 0 ? config.jobs : max(1u, thread::hardware_concurrency());
+    const uint64_t seed = next_search_seed();
+    JobQueue<Job> queue(2 * jobs);
+    mutex out_mutex;
+
+    auto solve = [&config, seed](const Job &job, ThreadPool &pool) {
+        ostringstream result;
+        result << "{\"line\":" << job.line;
+        if (!job.name.empty())
+        {
+            result << ",\"name\":" << json_string(job.name);
+        }
+        auto t_start = chrono::steady_clock::now();
+        try
+        {
+            const vector<int> target = parse_sequence(job.terms);
+            if (target.size() < 3)
+            {
+                throw invalid_argument("a target needs at least 3 terms");
+            }
+            uint64_t generations = 0;
+            uint64_t evaluations = 0;
+            SearchConfig search = cli_search_config();
+            search.pool = &pool;
+            search.seed = mix64(seed + job.line);
+            search.max_generations = config.max_generations;
+            search.max_millis = config.max_millis;
+            search.max_evaluations = config.max_evaluations;
+            search.generations = &generations;
+            search.evaluations = &evaluations;
+            const SearchResult searched = anytime_search(target, search);
+            result << ",\"terms\":" << target.size() << ",\"status\":" << (searched.solved() ? "\"solved\"" : "\"budget\"");
+            // Out of budget, the closest formula found and how far it is.
+            if (searched.best)
+            {
+                result << ",\"formula\":" << json_string(formula_string(searched.best))
+                       << ",\"simplified\":" << json_string(formula_string(simplify(searched.best)));
+            }
+            if (!searched.solved())
+            {
+                result << ",\"error\":" << searched.error << ",\"stop\":\"" << search_stop_name(searched.stop) << "\"";
+            }
+            result << ",\"generations\":" << generations << ",\"evaluations\":" << evaluations;
+        }
+        catch (const exception &e)
+        {
+            result << ",\"status\":\"error\",\"message\":" << json_string(e.what());
+        }
+        auto t_end = chrono::steady_clock::now();
+        result << ",\"ms\":" << chrono::duration<double, milli>(t_end - t_start).count() << "}";
+        return result.str();
+    };
+
+    vector<thread> workers;
+    for (size_t w = 0; w < jobs; w++)
+    {
+        workers.emplace_back([&] {
+            ThreadPool pool(1);
+            Job job;
+            while (queue.pop(job))
+            {
+                const string result = solve(job, pool);
+                lock_guard<mutex> lock(out_mutex);
+                out << result << endl;
+            }
+        });
+    }
+
+    string text;
+    for (size_t line = 1; getline(in, text); line++)
+    {
+        const size_t first = text.find_first_not_of(" \t\r");
+        if (first == string::npos || text[first] == '#')
+        {
+            continue;
+        }
+        Job job{ line, string(), string() };
+        size_t terms = first;
+        if (isalpha((unsigned char)text[first]))
+        {
+            terms = min(text.find_first_of(" \t:,", first), text.size());
+            job.name = text.substr(first, terms - first);
+            terms = text.find_first_not_of(" \t", terms);
+            if (terms != string::npos && text[terms] == ':')
+            {
+                terms++;
+            }
+        }
+        if (terms != string::npos)
+        {
+            job.terms = text.substr(terms);
+        }
+        queue.push(move(job));
+    }
+    queue.close();
+    for (thread &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void measure(int n = 100)
+{
+    ofstream logfile("measure.txt", ios_base::app);
+
+    logfile << "Count: " << n << endl << endl;
+
+    logfile << "Mutating search" << endl << endl;
+
+    size_t total = 0;
+
+    constexpr array<int, 8> target{ 0, 4, 30, 120, 340, 780, 1554, 2800 };
+
+    for (int i = 0; i < n; i++)
+    {
+        auto t_start = chrono::high_resolution_clock::now();
+        auto root = mutating_search(target, cli_search_config());
+        auto t_end = chrono::high_resolution_clock::now();
+        auto millisecs = chrono::duration_cast<chrono::milliseconds>(t_end - t_start);
+        total += millisecs.count();
+        logOperations(cout, (size_t)millisecs.count(), root, target);
+        logOperations(logfile, (size_t)millisecs.count(), root, target);
+    }
+
+    logfile << endl << "Total: " << total << endl; //-V128
+
+
+    // The enumerative search does the same work every time, so once is
+    // enough.
+    logfile << endl << "Enumerative search" << endl << endl;
+
+    auto t_start = chrono::high_resolution_clock::now();
+    EnumerativeConfig enumerative;
+    enumerative.pool = &search_pool();
+    auto root = enumerative_search(target, enumerative);
+    auto t_end = chrono::high_resolution_clock::now();
+    auto millisecs = chrono::duration_cast<chrono::milliseconds>(t_end - t_start);
+    if (root)
+    {
+        logOperations(cout, (size_t)millisecs.count(), root, target);
+        logOperations(logfile, (size_t)millisecs.count(), root, target);
+    }
+
+    logfile << endl << "Total: " << millisecs.count() << endl; //-V128
+}
+
+void bench_eval(size_t population = 4096, int reps = 200)
+{
+    constexpr array<int, 8> target{ 0, 4, 30, 120, 340, 780, 1554, 2800 };
+    constexpr int min_nodes_number = 5;
+    constexpr int max_nodes_number = 30;
+
+    vector<NodePtr> trees(population);
+    size_t nodes = 0;
+    for (auto &tree : trees)
+    {
+        do
+        {
+            tree = generate_operations();
+        } while (tree->size() < min_nodes_number || tree->size() > max_nodes_number);
+        nodes += tree->size();
+    }
+    const double node_evals = double(nodes) * (target.size() - 2) * reps;
+
+    long long sink = 0;
+    auto t_start = chrono::high_resolution_clock::now();
+    for (int r = 0; r < reps; r++)
+    {
+        for (const auto &tree : trees)
+        {
+            sink += calculate<8>(tree.get(), target[0], target[1]).back();
+        }
+    }
+    auto t_end = chrono::high_resolution_clock::now();
+    const double virtual_ns = chrono::duration<double, nano>(t_end - t_start).count();
+
+    vector<Program> programs(population);
+    for (size_t i = 0; i < population; i++)
+    {
+        trees[i]->compile(programs[i]);
+    }
+
+    Program scratch;
+    t_start = chrono::high_resolution_clock::now();
+    for (int r = 0; r < reps; r++)
+    {
+        for (const auto &tree : trees)
+        {
+            scratch.clear();
+            tree->compile(scratch);
+            sink += (long long)scratch.size();
+        }
+    }
+    t_end = chrono::high_resolution_clock::now();
+    const double compile_ns = chrono::duration<double, nano>(t_end - t_start).count();
+    sink -= (long long)nodes * reps;
+
+    t_start = chrono::high_resolution_clock::now();
+    for (int r = 0; r < reps; r++)
+    {
+        for (const auto &program : programs)
+        {
+            sink -= calculate<8>(program, target[0], target[1]).back();
+        }
+    }
+    t_end = chrono::high_resolution_clock::now();
+    const double bytecode_ns = chrono::duration<double, nano>(t_end - t_start).count();
+
+    cout << "Trees: " << population << ", nodes: " << nodes << ", reps: " << reps << endl;
+    cout << "Virtual eval:  " << virtual_ns / node_evals << " ns/node" << endl;
+    cout << "Bytecode eval: " << bytecode_ns / node_evals << " ns/node" << endl;
+    cout << "Compile:       " << compile_ns / ((double)nodes * reps) << " ns/node" << endl;
+    cout << "Checksum: " << sink << endl;
+
+    // Whole fitness checks, sequence plus error, one at a time and
+    // batched. Distinct random trees rarely share a shape; a converged
+    // population is closer to the second case, where every shape comes in
+    // 16 variants with their own leaves and operations.
+    vector<Program> variants(population);
+    vector<const Program*> distinct(population), shaped(population);
+    for (size_t i = 0; i < population; i++)
+    {
+        for (const Instr &instr : programs[i / 16].code())
+        {
+            if (instr.op >= OpCode::Plus)
+            {
+                variants[i].emit((OpCode)((int)OpCode::Plus + getRand<0, 2>()));
+            }
+            else
+            {
+                const auto leaf = (OpCode)getRand<0, 3>();
+                variants[i].emit(leaf, leaf == OpCode::Value ? getRand<0, 9>() : 0);
+            }
+        }
+        distinct[i] = &programs[i];
+        shaped[i] = &variants[i];
+    }
+    for (const auto &scenario : { make_pair("distinct trees", &distinct), make_pair("16 variants per shape", &shaped) })
+    {
+        const vector<const Program*> &batch = *scenario.second;
+        cout << "Fitness, " << scenario.first << ":" << endl;
+
+        vector<uint64_t> expected(population);
+        t_start = chrono::high_resolution_clock::now();
+        for (int r = 0; r < reps; r++)
+        {
+            for (size_t i = 0; i < population; i++)
+            {
+                expected[i] = squared_error(calculate<8>(*batch[i], target[0], target[1]), target);
+            }
+        }
+        t_end = chrono::high_resolution_clock::now();
+        const double scalar_ns = chrono::duration<double, nano>(t_end - t_start).count();
+        cout << "  One at a time:      " << population * reps / scalar_ns * 1e3 << " M evals/s" << endl;
+
+        vector<uint64_t> scores(population);
+        const SimdLevel best = detect_simd_level();
+        for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::AVX2, SimdLevel::AVX512 })
+        {
+            if (level > best)
+            {
+                break;
+            }
+            BatchEvaluator evaluator(level);
+            t_start = chrono::high_resolution_clock::now();
+            for (int r = 0; r < reps; r++)
+            {
+                evaluator.evaluate(batch, target.data(), target.size(), scores.data());
+            }
+            t_end = chrono::high_resolution_clock::now();
+            const double batch_ns = chrono::duration<double, nano>(t_end - t_start).count();
+            size_t mismatches = 0;
+            for (size_t i = 0; i < population; i++)
+            {
+                mismatches += scores[i] != expected[i];
+            }
+            cout << "  Batched, " << simd_level_name(level) << " x" << evaluator.lanes() << ": "
+                 << population * reps / batch_ns * 1e3 << " M evals/s, "
+                 << mismatches << " mismatches" << endl;
+        }
+    }
+}
+
+// What native code costs and what it buys: compile time per program,
+// evaluation time against the interpreter and the batched evaluator, the
+// number of evaluations after which compiling pays off, and search speed
+// at several reuse thresholds on a target that is never found.
+void bench_jit(size_t population = 4096, int reps = 200, size_t generations = 2000)
+{
+    constexpr array<int, 8> target{ 0, 4, 30, 120, 340, 780, 1554, 2800 };
+    constexpr int min_nodes_number = 5;
+    constexpr int max_nodes_number = 30;
+
+    if (!jit_supported())
+    {
+        cout << "JIT is not supported on this platform" << endl;
+        return;
+    }
+
+    vector<Program> programs(population);
+    vector<const Program*> batch(population);
+    for (size_t i = 0; i < population; i++)
+    {
+        NodePtr tree;
+        do
+        {
+            tree = generate_operations();
+        } while (tree->size() < min_nodes_number || tree->size() > max_nodes_number);
+        tree->compile(programs[i]);
+        batch[i] = &programs[i];
+    }
+
+    JitArena arena;
+    vector<unique_ptr<JitFunction>> functions(population);
+    double compile_ns = 0.;
+    for (int r = 0; r < reps; r++)
+    {
+        functions.clear();
+        functions.resize(population);
+        auto t_start = chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < population; i++)
+        {
+            functions[i] = jit_compile(arena, programs[i]);
+        }
+        auto t_end = chrono::high_resolution_clock::now();
+        compile_ns += chrono::duration<double, nano>(t_end - t_start).count();
+    }
+    compile_ns /= (double)population * reps;
+
+    vector<uint64_t> expected(population), scores(population);
+    auto t_start = chrono::high_resolution_clock::now();
+    for (int r = 0; r < reps; r++)
+    {
+        for (size_t i = 0; i < population; i++)
+        {
+            expected[i] = squared_error(calculate<8>(programs[i], target[0], target[1]), target);
+        }
+    }
+    auto t_end = chrono::high_resolution_clock::now();
+    const double vm_ns = chrono::duration<double, nano>(t_end - t_start).count() / ((double)population * reps);
+
+    BatchEvaluator evaluator;
+    t_start = chrono::high_resolution_clock::now();
+    for (int r = 0; r < reps; r++)
+    {
+        evaluator.evaluate(batch, target.data(), target.size(), scores.data());
+    }
+    t_end = chrono::high_resolution_clock::now();
+    const double batched_ns = chrono::duration<double, nano>(t_end - t_start).count() / ((double)population * reps);
+
+    size_t compiled = 0;
+    size_t mismatches = 0;
+    array<int, 8> result;
+    t_start = chrono::high_resolution_clock::now();
+    for (int r = 0; r < reps; r++)
+    {
+        for (size_t i = 0; i < population; i++)
+        {
+            if (functions[i])
+            {
+                result[0] = target[0];
+                result[1] = target[1];
+                functions[i]->run_sequence(result.data(), result.size());
+                scores[i] = squared_error(result, target);
+            }
+        }
+    }
+    t_end = chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < population; i++)
+    {
+        if (functions[i])
+        {
+            compiled++;
+            mismatches += scores[i] != expected[i];
+        }
+    }
+    const double jit_ns = chrono::duration<double, nano>(t_end - t_start).count() / ((double)compiled * reps);
+
+    cout << "Programs: " << population << ", compiled: " << compiled << ", mismatches: " << mismatches << endl;
+    cout << "Compile:           " << compile_ns << " ns/program" << endl;
+    cout << "Interpreter eval:  " << vm_ns << " ns" << endl;
+    cout << "Batched eval:      " << batched_ns << " ns" << endl;
+    cout << "Native eval:       " << jit_ns << " ns" << endl;
+    cout << "Break-even uses:   " << compile_ns / (vm_ns - jit_ns) << " vs interpreter, "
+         << compile_ns / (batched_ns - jit_ns) << " vs batched" << endl;
+
+    constexpr array<int, 8> unreachable{ 1, 7, 2, 90, -45, 3, 1000, 8 };
+    for (unsigned threshold : { 0u, 1u, 2u, 4u, 8u, 16u })
+    {
+        SearchConfig config = cli_search_config();
+        config.jit_threshold = threshold;
+        config.max_generations = generations;
+        t_start = chrono::high_resolution_clock::now();
+        mutating_search(unreachable, config);
+        t_end = chrono::high_resolution_clock::now();
+        cout << "Search, threshold " << threshold << ": "
+             << generations / chrono::duration<double>(t_end - t_start).count() << " generations/s" << endl;
+    }
+}
+
+// Search speed with 1, 2, 4, ... threads up to `max_threads` (0: one per
+// hardware thread), on a target that is never found.
+void bench_threads(size_t max_threads = 0, size_t generations = 2000)
+{
+    constexpr array<int, 8> unreachable{ 1, 7, 2, 90, -45, 3, 1000, 8 };
+    if (max_threads == 0)
+    {
+        max_threads = max(1u, thread::hardware_concurrency());
+    }
+
+    double single = 0.;
+    for (size_t threads = 1; threads <= max_threads; threads = threads * 2 > max_threads && threads < max_threads ? max_threads : threads * 2)
+    {
+        ThreadPool pool(threads);
+        SearchConfig config = cli_search_config();
+        config.max_generations = generations;
+        config.pool = &pool;
+        auto t_start = chrono::high_resolution_clock::now();
+        mutating_search(unreachable, config);
+        auto t_end = chrono::high_resolution_clock::now();
+        const double rate = generations / chrono::duration<double>(t_end - t_start).count();
+        if (threads == 1)
+        {
+            single = rate;
+        }
+        cout << "Threads: " << threads << ", " << rate << " generations/s, speedup " << rate / single << endl;
+    }
+}
+
+// Node memory over a search that is never finished: allocator traffic,
+// how often the store hands out a node that already exists, and how many
+// stored nodes the population takes against the nodes of its trees
+// counted one by one. After a warm-up search the pool should not need
+// any more memory from the system.
+void bench_alloc(size_t generations = 2000)
+{
+    constexpr array<int, 8> unreachable{ 1, 7, 2, 90, -45, 3, 1000, 8 };
+    SearchConfig config = cli_search_config();
+    config.max_generations = 200;
+    mutating_search(unreachable, config);
+
+    size_t tree_nodes = 0;
+    NodeStore::Stats live{ 0, 0, 0 };
+    config.max_generations = generations;
+    config.on_generation = [&](size_t generation, Population &gens, const Ranking&) {
+        if (generation + 1 == generations)
+        {
+            for (const auto &genPtr : gens)
+            {
+                tree_nodes += genPtr->size();
+            }
+            live = NodeStore::instance().stats();
+        }
+        return true;
+    };
+    const NodePool::Stats before = NodePool::instance().stats();
+    const NodeStore::Stats store_before = NodeStore::instance().stats();
+    auto t_start = chrono::high_resolution_clock::now();
+    mutating_search(unreachable, config);
+    auto t_end = chrono::high_resolution_clock::now();
+    const NodePool::Stats after = NodePool::instance().stats();
+    const NodeStore::Stats store_after = NodeStore::instance().stats();
+    const uint64_t allocations = (store_after.lookups - store_after.shared) - (store_before.lookups - store_before.shared);
+
+    cout << generations / chrono::duration<double>(t_end - t_start).count() << " generations/s, "
+         << allocations / generations << " allocations/generation, "
+         << after.system_allocations - before.system_allocations << " system allocations, "
+         << after.pages << " pages in use" << endl;
+    cout << "Shared on make: " << 100. * (store_after.shared - store_before.shared) / (store_after.lookups - store_before.lookups) << "%" << endl;
+    cout << "Population: " << tree_nodes << " tree nodes, " << live.nodes
+         << " stored nodes for it and the previous generation" << endl;
+}
+
+// Same searches with and without the fitness cache: how many find a
+// winner within `generations`, how fast, and how much evaluation the
+// cache saved.
+void bench_cache(size_t searches = 20, size_t generations = 3000)
+{
+    constexpr array<int, 8> target{ 0, 4, 30, 120, 340, 780, 1554, 2800 };
+    for (bool enabled : { false, true })
+    {
+        FitnessCache::Stats stats;
+        SearchConfig config = cli_search_config();
+        config.fitness_cache = enabled;
+        config.cache_stats = &stats;
+        config.max_generations = generations;
+        size_t total = 0;
+        size_t solved = 0;
+        config.on_generation = [&total](size_t, Population&, const Ranking&) { total++; return true; };
+        auto t_start = chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < searches; i++)
+        {
+            config.seed = i + 1;
+            solved += mutating_search(target, config) != nullptr;
+        }
+        auto t_end = chrono::high_resolution_clock::now();
+
+        cout << (enabled ? "Fitness cache: " : "No cache:      ")
+             << solved << "/" << searches << " solved, "
+             << chrono::duration<double, milli>(t_end - t_start).count() / searches << " ms/search, "
+             << (double)total / searches << " generations/search";
+        if (enabled)
+        {
+            cout << ", hit rate " << stats.hit_rate() * 100 << "%, "
+                 << (double)stats.duplicates / total << " duplicates and "
+                 << (double)stats.semantic_duplicates / total << " semantic duplicates/generation";
+        }
+        cout << endl;
+    }
+}
+
+// What simplification takes out of random trees and what that buys in
+// evaluation speed, then the same searches with and without it.
+void bench_simplify(size_t population = 4096, int reps = 200, size_t searches = 20, size_t generations = 3000)
+{
+    constexpr array<int, 8> target{ 0, 4, 30, 120, 340, 780, 1554, 2800 };
+    constexpr int max_nodes_number = 30;
+
+    vector<Program> before(population), after(population);
+    vector<const Program*> batch_before(population), batch_after(population);
+    for (size_t i = 0; i < population; i++)
+    {
+        NodePtr tree;
+        do
+        {
+            tree = generate_operations();
+        } while (tree->size() > max_nodes_number);
+        tree->compile(before[i]);
+        batch_before[i] = &before[i];
+        batch_after[i] = &after[i];
+    }
+    double simplify_ns = 0.;
+    for (int r = 0; r < reps; r++)
+    {
+        copy(before.begin(), before.end(), after.begin());
+        auto t_start = chrono::high_resolution_clock::now();
+        for (Program &program : after)
+        {
+            program.simplify();
+        }
+        auto t_end = chrono::high_resolution_clock::now();
+        simplify_ns += chrono::duration<double, nano>(t_end - t_start).count();
+    }
+
+    size_t nodes = 0, simple_nodes = 0, changed = 0, mismatches = 0;
+    for (size_t i = 0; i < population; i++)
+    {
+        nodes += before[i].size();
+        simple_nodes += after[i].size();
+        changed += after[i].size() != before[i].size();
+        // Longer than the target and from other seeds, to catch rules
+        // that only hold on the first few terms.
+        mismatches += calculate<32>(before[i], -3, 7) != calculate<32>(after[i], -3, 7);
+    }
+    cout << "Programs: " << population << ", simplified: " << changed << ", mismatches: " << mismatches << endl;
+    cout << "Nodes: " << nodes << " -> " << simple_nodes << ", "
+         << 100. * (nodes - simple_nodes) / nodes << "% removed" << endl;
+    cout << "Simplify: " << simplify_ns / ((double)population * reps) << " ns/program" << endl;
+
+    BatchEvaluator evaluator;
+    vector<uint64_t> errors(population);
+    uint64_t sink = 0;
+    double rates[2][2];
+    for (int simplified = 0; simplified < 2; simplified++)
+    {
+        const vector<Program> &programs = simplified ? after : before;
+        auto t_start = chrono::high_resolution_clock::now();
+        for (int r = 0; r < reps; r++)
+        {
+            for (size_t i = 0; i < population; i++)
+            {
+                sink += squared_error(calculate<8>(programs[i], target[0], target[1]), target);
+            }
+        }
+        auto t_end = chrono::high_resolution_clock::now();
+        rates[simplified][0] = population * reps / chrono::duration<double, micro>(t_end - t_start).count();
+        t_start = chrono::high_resolution_clock::now();
+        for (int r = 0; r < reps; r++)
+        {
+            evaluator.evaluate(simplified ? batch_after : batch_before, target.data(), target.size(), errors.data());
+            sink += errors[0];
+        }
+        t_end = chrono::high_resolution_clock::now();
+        rates[simplified][1] = population * reps / chrono::duration<double, micro>(t_end - t_start).count();
+    }
+    cout << "Interpreter: " << rates[0][0] << " -> " << rates[1][0] << " M evals/s, speedup " << rates[1][0] / rates[0][0] << endl;
+    cout << "Batched:     " << rates[0][1] << " -> " << rates[1][1] << " M evals/s, speedup " << rates[1][1] / rates[0][1] << endl;
+    cout << "Checksum: " << sink << endl;
+
+    for (bool enabled : { false, true })
+    {
+        SearchConfig config = cli_search_config();
+        config.simplify = enabled;
+        uint64_t removed = 0;
+        config.removed_nodes = &removed;
+        config.max_generations = generations;
+        size_t total = 0;
+        size_t solved = 0;
+        config.on_generation = [&total](size_t, Population&, const Ranking&) { total++; return true; };
+        auto t_start = chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < searches; i++)
+        {
+            config.seed = i + 1;
+            solved += mutating_search(target, config) != nullptr;
+        }
+        auto t_end = chrono::high_resolution_clock::now();
+        const double ms = chrono::duration<double, milli>(t_end - t_start).count();
+        cout << (enabled ? "Simplified search: " : "Plain search:      ")
+             << solved << "/" << searches << " solved, "
+             << ms / searches << " ms/search, "
+             << total / ms * 1e3 << " generations/s";
+        if (enabled)
+        {
+            cout << ", " << (double)removed / total << " nodes removed/generation";
+        }
+        cout << endl;
+    }
+}
 
-    logfile << endl << "Total: " << total << endl; //-V128
+// Ranking and parent picking alone on populations far larger than the
+// search's, where sorting everything starts to dominate, then the same
+// searches under each mode.
+void bench_select(size_t searches = 20, size_t generations = 3000)
+{
+    constexpr SelectionMode modes[] = { SelectionMode::sort, SelectionMode::truncation, SelectionMode::tournament, SelectionMode::proportional };
+    size_t sink = 0;
+    for (size_t population : { 10000, 100000, 1000000 })
+    {
+        const size_t elite = population / 4;
+        const size_t parents = population / 8;
+        const int reps = (int)(10000000 / population);
+        vector<Selector::Entry> scores(population), ranking(population);
+        for (size_t i = 0; i < population; i++)
+        {
+            scores[i] = make_pair(sqrt((double)thread_rng().next32()), i);
+        }
+        cout << "Population " << population << ":" << endl;
+        for (SelectionMode mode : modes)
+        {
+            Selector selector(mode, elite, parents);
+            double rank_ns = 0., pick_ns = 0.;
+            for (int r = 0; r < reps; r++)
+            {
+                ranking = scores;
+                auto t_start = chrono::high_resolution_clock::now();
+                selector.rank(ranking.data(), ranking.data() + ranking.size());
+                auto t_mid = chrono::high_resolution_clock::now();
+                // Two parents for each of population / 4 children.
+                for (size_t i = 0; i < population / 2; i++)
+                {
+                    sink += selector.pick();
+                }
+                auto t_end = chrono::high_resolution_clock::now();
+                rank_ns += chrono::duration<double, nano>(t_mid - t_start).count();
+                pick_ns += chrono::duration<double, nano>(t_end - t_mid).count();
+            }
+            cout << "  " << selection_mode_name(mode) << ": rank " << rank_ns / reps / 1e6 << " ms, picks "
+                 << pick_ns / reps / 1e6 << " ms, " << (rank_ns + pick_ns) / reps / population << " ns/individual" << endl;
+        }
+    }
+    cout << "Checksum: " << sink << endl;
+
+    constexpr array<int, 8> target{ 0, 4, 30, 120, 340, 780, 1554, 2800 };
+    for (SelectionMode mode : modes)
+    {
+        SearchConfig config = cli_search_config();
+        config.selection = mode;
+        config.max_generations = generations;
+        size_t total = 0;
+        size_t solved = 0;
+        config.on_generation = [&total](size_t, Population&, const Ranking&) { total++; return true; };
+        auto t_start = chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < searches; i++)
+        {
+            config.seed = i + 1;
+            solved += mutating_search(target, config) != nullptr;
+        }
+        auto t_end = chrono::high_resolution_clock::now();
+        cout << "Search, " << selection_mode_name(mode) << ": " << solved << "/" << searches << " solved, "
+             << chrono::duration<double, milli>(t_end - t_start).count() / searches << " ms/search, "
+             << (double)total / searches << " generations/search" << endl;
+    }
+}
+
+// Search speed on targets of several lengths that are never found, through
+// the search compiled for the length and through the one for any length.
+// Past max_fixed_length both are the same.
+void bench_length(size_t generations = 2000)
+{
+    for (size_t length : { 8, 12, 16, 24, 32, 48 })
+    {
+        vector<int> unreachable(length);
+        for (size_t i = 0; i < length; i++)
+        {
+            unreachable[i] = (int)(mix64(i + 1) % 2001) - 1000;
+        }
+        SearchConfig config = cli_search_config();
+        config.max_generations = generations;
+        config.seed = 1;
+        double rates[2];
+        for (int generic = 0; generic < 2; generic++)
+        {
+            auto t_start = chrono::high_resolution_clock::now();
+            generic ? mutating_search_of_length<0>(unreachable, config) : anytime_search(unreachable, config);
+            auto t_end = chrono::high_resolution_clock::now();
+            rates[generic] = generations / chrono::duration<double>(t_end - t_start).count();
+        }
+        cout << "Length " << length << ": " << rates[0] << " generations/s dispatched, "
+             << rates[1] << " generations/s generic" << endl;
+    }
+}
+
+struct BenchTarget
+{
+    const char *tier;
+    const char *name;
+    vector<int> terms;
+};
+
+// Time-to-solution corpus of seqgen_bench. Easy targets take the random
+// search milliseconds, medium ones take the mutating search well under a
+// second, hard ones run into the generation budget now and then.
+const vector<BenchTarget>& bench_corpus()
+{
+    static const vector<BenchTarget> corpus{
+        { "easy", "squares", { 1, 4, 9, 16, 25, 36, 49, 64 } },
+        { "easy", "odd", { 1, 3, 5, 7, 9, 11, 13, 15 } },
+        { "easy", "cubes", { 1, 8, 27, 64, 125, 216, 343, 512, 729, 1000 } },
+        { "medium", "fibonacci", { 1, 1, 2, 3, 5, 8, 13, 21 } },
+        { "medium", "pyramidal", { 0, 3, 14, 39, 84, 155 } },
+        { "hard", "quartic", { 0, 4, 30, 120, 340, 780, 1554, 2800 } },
+        { "hard", "factorial", { 1, 1, 5, 23, 119, 719, 5039, 40319 } },
+        { "hard", "pell", { 0, 1, 2, 5, 12, 29, 70, 169 } },
+    };
+    return corpus;
+}
+
+// The seqgen_bench target: microbenchmarks of the tree operations, then
+// time to solution over bench_corpus() for the mutating search and, on
+// the easy targets, the random one. Every random choice is seeded, so each
+// run does the same work. Results are JSON lines, see bench.h.
+//
+// --samples=N         samples of each microbenchmark, 21 by default
+// --search-samples=N  seeds each target is searched with, 11 by default
+// --budget=N          generations before a search counts as unsolved
+// Other arguments select the benchmarks whose name contains one of them.
+int bench_suite(const vector<string> &args)
+{
+    size_t samples = 21;
+    size_t search_samples = 11;
+    size_t budget = 5000;
+    vector<string> filters;
+    for (const string &arg : args)
+    {
+        if (arg.compare(0, 10, "--samples=") == 0)
+        {
+            if (!parse_arg("--samples", arg.substr(10), samples))
+            {
+                return 1;
+            }
+        }
+        else if (arg.compare(0, 17, "--search-samples=") == 0)
+        {
+            if (!parse_arg("--search-samples", arg.substr(17), search_samples))
+            {
+                return 1;
+            }
+        }
+        else if (arg.compare(0, 9, "--budget=") == 0)
+        {
+            if (!parse_arg("--budget", arg.substr(9), budget))
+            {
+                return 1;
+            }
+        }
+        else
+        {
+            filters.push_back(arg);
+        }
+    }
+    auto selected = [&filters](const string &name) {
+        return filters.empty() || any_of(filters.begin(), filters.end(), [&name](const string &filter) { return name.find(filter) != string::npos; });
+    };
+
+    constexpr uint64_t bench_seed = 1;
+    cout << "{\"suite\":\"seqgen_bench\",\"threads\":" << search_pool().size()
+         << ",\"simd\":\"" << simd_level_name(detect_simd_level()) << "\"}" << endl;
+
+    // Same trees on every run.
+    constexpr size_t tree_count = 1024;
+    constexpr size_t ops = 4096;
+    vector<NodePtr> trees(tree_count);
+    vector<Program> programs(tree_count);
+    size_t nodes = 0;
+    for (size_t i = 0; i < tree_count; i++)
+    {
+        seed_thread_rng(bench_seed, i);
+        trees[i] = generate_operations();
+        trees[i]->compile(programs[i]);
+        nodes += trees[i]->size();
+    }
+    const BenchFields tree_fields{ { "nodes_per_tree", to_string((double)nodes / tree_count) } };
+    int64_t sink = 0;
+
+    if (selected("eval"))
+    {
+        // XPP 2, XP 3.
+        const int history[] = { 2, 3 };
+        write_bench(cout, "eval", "ns/op", time_per_op(samples, ops, [&](size_t i) {
+            sink += trees[i % tree_count]->eval(5, history + 2, 5);
+        }), tree_fields);
+    }
+    if (selected("generate_operations"))
+    {
+        seed_thread_rng(bench_seed, tree_count);
+        write_bench(cout, "generate_operations", "ns/op", time_per_op(samples, ops, [&](size_t) {
+            sink += generate_operations()->size();
+        }));
+    }
+    if (selected("hybridise"))
+    {
+        seed_thread_rng(bench_seed, tree_count + 1);
+        write_bench(cout, "hybridise", "ns/op", time_per_op(samples, ops, [&](size_t i) {
+            sink += hybridise(trees[i % tree_count].get(), trees[(i * 7 + 1) % tree_count].get())->size();
+        }), tree_fields);
+    }
+    if (selected("mutate"))
+    {
+        seed_thread_rng(bench_seed, tree_count + 2);
+        write_bench(cout, "mutate", "ns/op", time_per_op(samples, ops, [&](size_t i) {
+            NodePtr tree = trees[i % tree_count];
+            mutate(tree);
+            sink += tree->size();
+        }), tree_fields);
+    }
+    if (selected("calculate_tree"))
+    {
+        write_bench(cout, "calculate_tree", "ns/op", time_per_op(samples, ops, [&](size_t i) {
+            sink += calculate<8>(trees[i % tree_count].get(), 1, 2).back();
+        }), tree_fields);
+    }
+    if (selected("calculate_program"))
+    {
+        write_bench(cout, "calculate_program", "ns/op", time_per_op(samples, ops, [&](size_t i) {
+            sink += calculate<8>(programs[i % tree_count], 1, 2).back();
+        }), tree_fields);
+    }
+    // Staged the way the evaluator stages a lone program, building
+    // included, at a short and a long length.
+    for (size_t length : { 8, 32 })
+    {
+        const string suffix = "/" + to_string(length);
+        vector<int> seq(length);
+        StagedProgram staged;
+        if (selected("calculate_program" + suffix))
+        {
+            write_bench(cout, "calculate_program" + suffix, "ns/op", time_per_op(samples, ops, [&](size_t i) {
+                seq[0] = 1;
+                seq[1] = 2;
+                programs[i % tree_count].run_sequence(seq.data(), length);
+                sink += seq.back();
+            }), tree_fields);
+        }
+        if (selected("calculate_staged" + suffix))
+        {
+            write_bench(cout, "calculate_staged" + suffix, "ns/op", time_per_op(samples, ops, [&](size_t i) {
+                seq[0] = 1;
+                seq[1] = 2;
+                staged.build(programs[i % tree_count]);
+                staged.run_sequence(seq.data(), length);
+                sink += seq.back();
+            }), tree_fields);
+        }
+    }
+    // Scoring in each arithmetic domain; wrapping is the interpreter the
+    // search has always run.
+    auto bench_domain = [&](const string &name, auto arithmetic) {
+        using Arithmetic = decltype(arithmetic);
+        if (!selected(name))
+        {
+            return;
+        }
+        const int target[8] = { 1, 2, 3, 5, 8, 13, 21, 34 };
+        vector<typename Arithmetic::value_type> seq(8);
+        write_bench(cout, name, "ns/op", time_per_op(samples, ops, [&](size_t i) {
+            seq[0] = Arithmetic::from_int(target[0]);
+            seq[1] = Arithmetic::from_int(target[1]);
+            sink += programs[i % tree_count].template run_scored_in<Arithmetic>(seq.data(), target, 8);
+        }), tree_fields);
+    };
+    bench_domain("run_scored/wrapping", WrappingArithmetic());
+    bench_domain("run_scored/checked", CheckedArithmetic());
+    bench_domain("run_scored/int64", Int64Arithmetic());
+    bench_domain("run_scored/int128", Int128Arithmetic());
+    bench_domain("run_scored/modular", ModularArithmetic());
+
+    for (const BenchTarget &target : bench_corpus())
+    {
+        const string name = string("mutating_search/") + target.tier + "/" + target.name;
+        if (!selected(name))
+        {
+            continue;
+        }
+        BenchSamples millis;
+        BenchSamples generations;
+        size_t solved = 0;
+        for (size_t s = 0; s < search_samples; s++)
+        {
+            uint64_t count = 0;
+            SearchConfig config = cli_search_config();
+            config.seed = mix64(bench_seed + s);
+            config.max_generations = budget;
+            config.generations = &count;
+            auto t_start = chrono::steady_clock::now();
+            solved += mutating_search(target.terms, config) != nullptr;
+            auto t_end = chrono::steady_clock::now();
+            millis.add(chrono::duration<double, milli>(t_end - t_start).count());
+            generations.add((double)count);
+        }
+        write_bench(cout, name, "ms", millis, { { "solved", to_string(solved) }, { "budget", to_string(budget) },
+            { "median_generations", to_string((uint64_t)generations.median()) } });
+    }
+
+    for (const BenchTarget &target : bench_corpus())
+    {
+        const string name = string("dumb_random_search/") + target.tier + "/" + target.name;
+        if (string(target.tier) != "easy" || !selected(name))
+        {
+            continue;
+        }
+        BenchSamples millis;
+        for (size_t s = 0; s < search_samples; s++)
+        {
+            seed_thread_rng(bench_seed, s);
+            auto t_start = chrono::steady_clock::now();
+            sink += dumb_random_search(target.terms)->size();
+            auto t_end = chrono::steady_clock::now();
+            millis.add(chrono::duration<double, milli>(t_end - t_start).count());
+        }
+        write_bench(cout, name, "ms", millis);
+    }
+
+    // The enumerative search is deterministic, so a few samples show the
+    // timing noise. Sizes above 11 take seconds per target.
+    for (const BenchTarget &target : bench_corpus())
+    {
+        const string name = string("enumerative_search/") + target.tier + "/" + target.name;
+        if (!selected(name))
+        {
+            continue;
+        }
+        BenchSamples millis;
+        uint64_t candidates = 0;
+        uint64_t kept = 0;
+        int size = 0;
+        for (size_t s = 0; s < 3; s++)
+        {
+            EnumerativeConfig config;
+            config.pool = &search_pool();
+            config.max_size = 11;
+            config.candidates = &candidates;
+            config.kept = &kept;
+            auto t_start = chrono::steady_clock::now();
+            NodePtr root = enumerative_search(target.terms, config);
+            auto t_end = chrono::steady_clock::now();
+            millis.add(chrono::duration<double, milli>(t_end - t_start).count());
+            size = root ? root->size() : 0;
+        }
+        write_bench(cout, name, "ms", millis, { { "solved", to_string(size != 0) }, { "size", to_string(size) },
+            { "candidates", to_string(candidates / 3) }, { "kept", to_string(kept / 3) } });
+    }
+
+    // Keeps the work from being optimized away.
+    cerr << "Checksum: " << sink << endl;
+    return 0;
 }
 
-int main()
+#ifdef SEQGEN_BENCH
+int main(int argc, char *argv[])
 {
+    return bench_suite(vector<string>(argv + 1, argv + argc));
+}
+#else
+int main(int argc, char *argv[])
+{
+    // --seed=N anywhere on the command line replays a previous run,
+    // --selection=<mode> changes how searches pick parents,
+    // --telemetry=<file> writes search telemetry there, as CSV if the name
+    // ends in .csv and JSON lines otherwise, every
+    // --telemetry-interval=N generations, --store=<file> looks up and keeps
+    // solutions there.
+    vector<string> args;
+    string telemetry_path;
+    string store_path;
+    for (int i = 1; i < argc; i++)
+    {
+        const string arg = argv[i];
+        if (arg.compare(0, 7, "--seed=") == 0)
+        {
+            uint64_t seed;
+            if (!parse_arg("--seed", arg.substr(7), seed))
+            {
+                return 1;
+            }
+            set_global_seed(seed);
+        }
+        else if (arg.compare(0, 12, "--selection=") == 0)
+        {
+            try
+            {
+                default_selection = parse_selection_mode(arg.substr(12));
+            }
+            catch (const invalid_argument &e)
+            {
+                cerr << e.what() << endl;
+                return 1;
+            }
+        }
+        else if (arg.compare(0, 12, "--telemetry=") == 0)
+        {
+            telemetry_path = arg.substr(12);
+        }
+        else if (arg.compare(0, 21, "--telemetry-interval=") == 0)
+        {
+            if (!parse_arg("--telemetry-interval", arg.substr(21), default_telemetry_interval))
+            {
+                return 1;
+            }
+        }
+        else if (arg.compare(0, 8, "--store=") == 0)
+        {
+            store_path = arg.substr(8);
+        }
+        else
+        {
+            args.push_back(arg);
+        }
+    }
+    cerr << "Seed: " << global_seed() << endl;
+
+    unique_ptr<SolutionStore> store;
+    if (!store_path.empty())
+    {
+        try
+        {
+            store.reset(new SolutionStore(store_path));
+        }
+        catch (const runtime_error &e)
+        {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        default_store = store.get();
+    }
+
+    ofstream telemetry_file;
+    if (!telemetry_path.empty())
+    {
+        telemetry_file.open(telemetry_path);
+        if (!telemetry_file)
+        {
+            cerr << "Cannot open " << telemetry_path << endl;
+            return 1;
+        }
+        const bool csv = telemetry_path.size() >= 4 && telemetry_path.compare(telemetry_path.size() - 4, 4, ".csv") == 0;
+        default_telemetry = csv ? telemetry_csv(telemetry_file) : telemetry_json(telemetry_file);
+    }
+
+    const string mode = args.empty() ? string() : args[0];
+    if (mode == "bench-eval")
+    {
+        bench_eval();
+        return 0;
+    }
+    if (mode == "bench-jit")
+    {
+        bench_jit();
+        return 0;
+    }
+    if (mode == "bench-alloc")
+    {
+        bench_alloc();
+        return 0;
+    }
+    if (mode == "bench-cache")
+    {
+        size_t count = 20;
+        if (args.size() > 1 && !parse_arg("bench-cache", args[1], count))
+        {
+            return 1;
+        }
+        bench_cache(count);
+        return 0;
+    }
+    if (mode == "bench-simplify")
+    {
+        size_t count = 20;
+        if (args.size() > 1 && !parse_arg("bench-simplify", args[1], count))
+        {
+            return 1;
+        }
+        bench_simplify(4096, 200, count);
+        return 0;
+    }
+    if (mode == "bench-select")
+    {
+        size_t count = 20;
+        if (args.size() > 1 && !parse_arg("bench-select", args[1], count))
+        {
+            return 1;
+        }
+        bench_select(count);
+        return 0;
+    }
+    if (mode == "bench-threads")
+    {
+        size_t count = 0;
+        if (args.size() > 1 && !parse_arg("bench-threads", args[1], count))
+        {
+            return 1;
+        }
+        bench_threads(count);
+        return 0;
+    }
+    if (mode == "bench-length")
+    {
+        bench_length();
+        return 0;
+    }
+    // solve 0 4 30 120 340 780, or the terms in one argument separated by
+    // commas: a target of any length, at least 3 terms.
+    // --checkpoint=<file> saves the search every --checkpoint-interval=N
+    // generations; --resume=<file> goes on with a saved one, the target
+    // then being optional. --lookback=K lets formulas read up to K terms
+    // back, --prefix-sum the sum of the terms so far, and
+    // --variable-weights=N,XP,XPP,LAG,SUM sets the odds of drawing each
+    // variable, see SearchConfig.
+    if (mode == "solve")
+    {
+        SearchConfig config = cli_search_config();
+        string text;
+        for (size_t i = 1; i < args.size(); i++)
+        {
+            const string &arg = args[i];
+            if (arg.compare(0, 13, "--checkpoint=") == 0)
+            {
+                config.checkpoint_path = arg.substr(13);
+            }
+            else if (arg.compare(0, 22, "--checkpoint-interval=") == 0)
+            {
+                if (!parse_arg("--checkpoint-interval", arg.substr(22), config.checkpoint_interval))
+                {
+                    return 1;
+                }
+            }
+            else if (arg.compare(0, 9, "--resume=") == 0)
+            {
+                config.resume_path = arg.substr(9);
+            }
+            else if (arg.compare(0, 11, "--lookback=") == 0)
+            {
+                if (!parse_arg("--lookback", arg.substr(11), config.lookback))
+                {
+                    return 1;
+                }
+            }
+            else if (arg == "--prefix-sum")
+            {
+                config.prefix_sum = true;
+            }
+            else if (arg.compare(0, 19, "--variable-weights=") == 0)
+            {
+                vector<int> weights;
+                try
+                {
+                    weights = parse_sequence(arg.substr(19));
+                }
+                catch (const invalid_argument&)
+                {
+                    weights.clear();
+                }
+                if (weights.size() != 5 || *min_element(weights.begin(), weights.end()) < 0)
+                {
+                    cerr << "--variable-weights takes 5 weights: N, XP, XPP, each lag and SUM" << endl;
+                    return 1;
+                }
+                config.variable_weights = VariableWeights{ (uint32_t)weights[0], (uint32_t)weights[1], (uint32_t)weights[2],
+                    (uint32_t)weights[3], (uint32_t)weights[4] };
+            }
+            else
+            {
+                text += arg + " ";
+            }
+        }
+        vector<int> target;
+        NodePtr root;
+        auto t_start = chrono::high_resolution_clock::now();
+        try
+        {
+            target = parse_sequence(text);
+            if (target.empty() && !config.resume_path.empty())
+            {
+                target = load_checkpoint(config.resume_path).target;
+            }
+            if (target.size() < 3)
+            {
+                cerr << "A target needs at least 3 terms" << endl;
+                return 1;
+            }
+            root = mutating_search(target, config);
+        }
+        catch (const runtime_error &e)
+        {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        catch (const invalid_argument &e)
+        {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        auto t_end = chrono::high_resolution_clock::now();
+        logOperations(cout, (size_t)chrono::duration_cast<chrono::milliseconds>(t_end - t_start).count(), root, target,
+            config.lookback);
+        return 0;
+    }
+    // batch [file] [--jobs=N] [--max-generations=N] [--max-ms=N]
+    //   [--max-evaluations=N]: the sequences of a file, or of stdin
+    // without one, see solve_batch.
+    if (mode == "batch")
+    {
+        BatchConfig config;
+        string path;
+        for (size_t i = 1; i < args.size(); i++)
+        {
+            const string &arg = args[i];
+            if (arg.compare(0, 7, "--jobs=") == 0)
+            {
+                if (!parse_arg("--jobs", arg.substr(7), config.jobs))
+                {
+                    return 1;
+                }
+            }
+            else if (arg.compare(0, 18, "--max-generations=") == 0)
+            {
+                if (!parse_arg("--max-generations", arg.substr(18), config.max_generations))
+                {
+                    return 1;
+                }
+            }
+            else if (arg.compare(0, 9, "--max-ms=") == 0)
+            {
+                if (!parse_arg("--max-ms", arg.substr(9), config.max_millis))
+                {
+                    return 1;
+                }
+            }
+            else if (arg.compare(0, 18, "--max-evaluations=") == 0)
+            {
+                if (!parse_arg("--max-evaluations", arg.substr(18), config.max_evaluations))
+                {
+                    return 1;
+                }
+            }
+            else
+            {
+                path = arg;
+            }
+        }
+        if (path.empty() || path == "-")
+        {
+            solve_batch(cin, cout, config);
+            return 0;
+        }
+        ifstream input(path);
+        if (!input)
+        {
+            cerr << "Cannot open " << path << endl;
+            return 1;
+        }
+        solve_batch(input, cout, config);
+        return 0;
+    }
+    // enumerate 0 4 30 120 340 780 [--max-size=N] [--memory-mb=N]: the
+    // smallest formula giving the target exactly, see enumerative_search.
+    if (mode == "enumerate")
+    {
+        EnumerativeConfig config;
+        config.pool = &search_pool();
+        string text;
+        for (size_t i = 1; i < args.size(); i++)
+        {
+            const string &arg = args[i];
+            if (arg.compare(0, 11, "--max-size=") == 0)
+            {
+                if (!parse_arg("--max-size", arg.substr(11), config.max_size))
+                {
+                    return 1;
+                }
+            }
+            else if (arg.compare(0, 12, "--memory-mb=") == 0)
+            {
+                size_t megabytes;
+                if (!parse_arg("--memory-mb", arg.substr(12), megabytes, numeric_limits<size_t>::max() >> 20))
+                {
+                    return 1;
+                }
+                config.memory_limit = megabytes << 20;
+            }
+            else
+            {
+                text += arg + " ";
+            }
+        }
+        vector<int> target;
+        try
+        {
+            target = parse_sequence(text);
+        }
+        catch (const invalid_argument &e)
+        {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        if (target.size() < 3)
+        {
+            cerr << "A target needs at least 3 terms" << endl;
+            return 1;
+        }
+        auto t_start = chrono::high_resolution_clock::now();
+        auto root = enumerative_search(target, config);
+        auto t_end = chrono::high_resolution_clock::now();
+        if (!root)
+        {
+            cout << "No formula of up to " << config.max_size << " nodes" << endl;
+            return 1;
+        }
+        logOperations(cout, (size_t)chrono::duration_cast<chrono::milliseconds>(t_end - t_start).count(), root, target);
+        return 0;
+    }
+    if (mode == "islands")
+    {
+        constexpr array<int, 8> target{ 0, 4, 30, 120, 340, 780, 1554, 2800 };
+        size_t islands = max(2u, thread::hardware_concurrency());
+        if (args.size() > 1 && !parse_arg("islands", args[1], islands))
+        {
+            return 1;
+        }
+        auto t_start = chrono::high_resolution_clock::now();
+        auto root = island_search(target, islands);
+        auto t_end = chrono::high_resolution_clock::now();
+        if (!root)
+        {
+            cout << "No island found a solution" << endl;
+            return 1;
+        }
+        logOperations(cout, (size_t)chrono::duration_cast<chrono::milliseconds>(t_end - t_start).count(), root, target);
+        return 0;
+    }
+
     /*ofstream logfile("out.txt", ios_base::app);
     auto t_start = chrono::high_resolution_clock::now();
 
@@ -591,3 +3347,6 @@ int main()
     measure();
     return 0;
 }
+#endif
+
+#endif  // SEQGEN_LIBRARY
@@ -0,0 +1,167 @@
+#ifndef ARITHMETIC_H
+#define ARITHMETIC_H
+
+// Arithmetic domains of the evaluators. A domain has a value type, the
+// three operations, each returning false for a result it cannot hold,
+// and the squared error of a value against a term of the target:
+//
+//   WrappingArithmetic  int, wrapping around on overflow; the default,
+//                       and the only one the SIMD kernels and the JIT run
+//   CheckedArithmetic   int, rejecting a candidate at its first overflow
+//   Int64Arithmetic     64 bits, rejecting on overflow of those
+//   Int128Arithmetic    128 bits, likewise
+//   ModularArithmetic   residues modulo SEQGEN_MODULUS, the error being
+//                       the distance around the circle
+//
+// A domain that cannot fail compiles its checks away, so the wrapping
+// instantiations of the interpreter are the plain int code. The search
+// runs in SearchArithmetic, picked at build time by SEQGEN_ARITHMETIC,
+// the index of a domain in the list above.
+
+#include <cstdint>
+#include <string>
+
+#ifndef SEQGEN_ARITHMETIC
+#define SEQGEN_ARITHMETIC 0
+#endif
+
+#ifndef SEQGEN_MODULUS
+#define SEQGEN_MODULUS 1000000007u
+#endif
+
+// Overflow wraps around instead of being UB, so every evaluation path
+// produces exactly the same sequence.
+inline int wrapping_add(int lhs, int rhs) { return (int)((unsigned)lhs + (unsigned)rhs); }
+inline int wrapping_sub(int lhs, int rhs) { return (int)((unsigned)lhs - (unsigned)rhs); }
+inline int wrapping_mul(int lhs, int rhs) { return (int)((unsigned)lhs * (unsigned)rhs); }
+
+// Fitness is the squared error against the target, in integers. The
+// difference wraps like the rest, so a square takes at most 62 bits and
+// a sum sticks at UINT64_MAX instead of wrapping.
+inline std::uint64_t squared_diff(int lhs, int rhs)
+{
+    const std::int64_t diff = wrapping_sub(lhs, rhs);
+    return (std::uint64_t)(diff * diff);
+}
+
+inline std::uint64_t saturating_add(std::uint64_t lhs, std::uint64_t rhs)
+{
+    const std::uint64_t sum = lhs + rhs;
+    return sum < lhs ? UINT64_MAX : sum;
+}
+
+// Square of a difference of any size, stuck at UINT64_MAX past it.
+inline std::uint64_t saturating_square(unsigned __int128 magnitude)
+{
+    return magnitude > UINT32_MAX ? UINT64_MAX : (std::uint64_t)(magnitude * magnitude);
+}
+
+struct WrappingArithmetic
+{
+    using value_type = int;
+    static constexpr bool can_fail = false;
+
+    static value_type from_int(int value) { return value; }
+    static bool add(value_type lhs, value_type rhs, value_type &out) { out = wrapping_add(lhs, rhs); return true; }
+    static bool sub(value_type lhs, value_type rhs, value_type &out) { out = wrapping_sub(lhs, rhs); return true; }
+    static bool mul(value_type lhs, value_type rhs, value_type &out) { out = wrapping_mul(lhs, rhs); return true; }
+    static std::uint64_t squared_error(value_type value, int target) { return squared_diff(value, target); }
+    static std::string to_string(value_type value) { return std::to_string(value); }
+};
+
+// The overflow-checked domains, over a signed integer type.
+template <class T>
+struct CheckedArithmeticOf
+{
+    using value_type = T;
+    static constexpr bool can_fail = true;
+
+    static value_type from_int(int value) { return value; }
+    static bool add(value_type lhs, value_type rhs, value_type &out) { return !__builtin_add_overflow(lhs, rhs, &out); }
+    static bool sub(value_type lhs, value_type rhs, value_type &out) { return !__builtin_sub_overflow(lhs, rhs, &out); }
+    static bool mul(value_type lhs, value_type rhs, value_type &out) { return !__builtin_mul_overflow(lhs, rhs, &out); }
+
+    static std::uint64_t squared_error(value_type value, int target)
+    {
+        __int128 diff;
+        if (__builtin_sub_overflow((__int128)value, (__int128)target, &diff))
+        {
+            return UINT64_MAX;
+        }
+        return saturating_square(diff < 0 ? -(unsigned __int128)diff : (unsigned __int128)diff);
+    }
+
+    static std::string to_string(value_type value)
+    {
+        // No std::to_string for 128 bits.
+        unsigned __int128 magnitude = value < 0 ? -(unsigned __int128)value : (unsigned __int128)value;
+        std::string digits;
+        do
+        {
+            digits.insert(digits.begin(), (char)('0' + (int)(magnitude % 10)));
+            magnitude /= 10;
+        } while (magnitude != 0);
+        return value < 0 ? "-" + digits : digits;
+    }
+};
+
+using CheckedArithmetic = CheckedArithmeticOf<int>;
+using Int64Arithmetic = CheckedArithmeticOf<std::int64_t>;
+using Int128Arithmetic = CheckedArithmeticOf<__int128>;
+
+// Residues below a modulus under 2^32, so that a product fits 64 bits.
+template <std::uint32_t Modulus>
+struct ModularArithmeticOf
+{
+    static_assert(Modulus > 1, "a modulus above 1");
+
+    using value_type = std::uint32_t;
+    static constexpr bool can_fail = false;
+
+    static value_type from_int(int value)
+    {
+        const std::int64_t residue = (std::int64_t)value % Modulus;
+        return (value_type)(residue < 0 ? residue + Modulus : residue);
+    }
+    static bool add(value_type lhs, value_type rhs, value_type &out)
+    {
+        out = (value_type)(((std::uint64_t)lhs + rhs) % Modulus);
+        return true;
+    }
+    static bool sub(value_type lhs, value_type rhs, value_type &out)
+    {
+        out = (value_type)(((std::uint64_t)lhs + Modulus - rhs) % Modulus);
+        return true;
+    }
+    static bool mul(value_type lhs, value_type rhs, value_type &out)
+    {
+        out = (value_type)((std::uint64_t)lhs * rhs % Modulus);
+        return true;
+    }
+    static std::uint64_t squared_error(value_type value, int target)
+    {
+        const value_type residue = from_int(target);
+        const std::uint64_t diff = value > residue ? value - residue : residue - value;
+        const std::uint64_t distance = diff < Modulus - diff ? diff : Modulus - diff;
+        return distance * distance;
+    }
+    static std::string to_string(value_type value) { return std::to_string(value); }
+};
+
+using ModularArithmetic = ModularArithmeticOf<SEQGEN_MODULUS>;
+
+#if SEQGEN_ARITHMETIC == 0
+using SearchArithmetic = WrappingArithmetic;
+#elif SEQGEN_ARITHMETIC == 1
+using SearchArithmetic = CheckedArithmetic;
+#elif SEQGEN_ARITHMETIC == 2
+using SearchArithmetic = Int64Arithmetic;
+#elif SEQGEN_ARITHMETIC == 3
+using SearchArithmetic = Int128Arithmetic;
+#elif SEQGEN_ARITHMETIC == 4
+using SearchArithmetic = ModularArithmetic;
+#else
+#error "SEQGEN_ARITHMETIC is the index of a domain, 0 to 4"
+#endif
+
+#endif  // ARITHMETIC_H
@@ -0,0 +1,83 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Measurements for the seqgen_bench suite. A benchmark is a number of
+// samples of one quantity, reported as one JSON object per line with the
+// median and 95th percentile, which vary far less between runs than the
+// mean does on a busy machine:
+//   {"bench":"eval","unit":"ns/op","samples":31,"median":9.8,"p95":10.4,...}
+// Extra fields go after the summary.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+class BenchSamples
+{
+public:
+    void add(double value) { values_.push_back(value); }
+
+    std::size_t size() const noexcept { return values_.size(); }
+
+    // Nearest-rank percentile, p in [0, 100].
+    double percentile(double p) const
+    {
+        if (values_.empty())
+        {
+            return 0.;
+        }
+        std::vector<double> sorted = values_;
+        std::sort(sorted.begin(), sorted.end());
+        const std::size_t rank = (std::size_t)(p / 100. * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(rank, sorted.size() - 1)];
+    }
+
+    double median() const { return percentile(50.); }
+    double min() const { return percentile(0.); }
+    double max() const { return percentile(100.); }
+
+private:
+    std::vector<double> values_;
+};
+
+// `samples` timings of `ops` calls of fn(i), i counting from 0 across all
+// of them, in nanoseconds per call.
+template <class F>
+BenchSamples time_per_op(std::size_t samples, std::size_t ops, F &&fn)
+{
+    BenchSamples result;
+    std::size_t i = 0;
+    for (std::size_t s = 0; s < samples; s++)
+    {
+        const auto t_start = std::chrono::steady_clock::now();
+        for (std::size_t k = 0; k < ops; k++)
+        {
+            fn(i++);
+        }
+        const auto t_end = std::chrono::steady_clock::now();
+        result.add(std::chrono::duration<double, std::nano>(t_end - t_start).count() / ops);
+    }
+    return result;
+}
+
+// Names and values of the extra fields, already formatted as JSON.
+using BenchFields = std::vector<std::pair<std::string, std::string>>;
+
+inline void write_bench(std::ostream &strm, const std::string &name, const std::string &unit, const BenchSamples &samples,
+    const BenchFields &extra = BenchFields())
+{
+    strm << "{\"bench\":\"" << name << "\",\"unit\":\"" << unit << "\",\"samples\":" << samples.size()
+         << ",\"median\":" << samples.median() << ",\"p95\":" << samples.percentile(95.)
+         << ",\"min\":" << samples.min() << ",\"max\":" << samples.max();
+    for (const auto &field : extra)
+    {
+        strm << ",\"" << field.first << "\":" << field.second;
+    }
+    strm << "}" << std::endl;
+}
+
+#endif  // BENCH_H
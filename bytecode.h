@@ -0,0 +1,860 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+// Flat postfix form of a Node tree and a small stack machine to run it.
+// A tree is compiled once and then evaluated for every step of the
+// sequence without touching the node hierarchy again.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "arithmetic.h"
+
+// Leaves come before the operations. Lag reads the term `arg` steps back,
+// a(n - arg), and Sum the sum of all the terms before the current one.
+enum class OpCode : std::uint8_t
+{
+    Value,
+    N,
+    XP,
+    XPP,
+    Lag,
+    Sum,
+    Plus,
+    Minus,
+    Mul
+};
+
+struct Instr
+{
+    OpCode op;
+    int arg;
+};
+
+class Program
+{
+public:
+    void clear() noexcept
+    {
+        code_.clear();
+        depth_ = 0;
+        max_depth_ = 0;
+    }
+
+    void emit(OpCode op, int arg = 0)
+    {
+        code_.push_back(Instr{ op, arg });
+        if (op < OpCode::Plus)
+        {
+            if (++depth_ > max_depth_)
+            {
+                max_depth_ = depth_;
+            }
+        }
+        else
+        {
+            --depth_;
+        }
+    }
+
+    const std::vector<Instr>& code() const noexcept { return code_; }
+    std::size_t size() const noexcept { return code_.size(); }
+    std::size_t stack_depth() const noexcept { return max_depth_; }
+
+    // How many terms back the program reads, 2 for XPP, and whether it
+    // reads Sum: a run needs at least that many seed terms.
+    std::size_t lookback() const noexcept
+    {
+        std::size_t back = 0;
+        for (const Instr &instr : code_)
+        {
+            const std::size_t k = instr.op == OpCode::XP ? 1 : instr.op == OpCode::XPP ? 2
+                : instr.op == OpCode::Lag ? (std::size_t)instr.arg : 0;
+            back = std::max(back, k);
+        }
+        return back;
+    }
+    bool reads_sum() const noexcept
+    {
+        return std::any_of(code_.begin(), code_.end(), [](const Instr &instr) { return instr.op == OpCode::Sum; });
+    }
+
+    // FNV-1a over the instructions. Postfix code determines the tree, so
+    // this is a structural hash of the tree the program was compiled from.
+    std::uint64_t hash() const noexcept
+    {
+        std::uint64_t h = 14695981039346656037ull;
+        for (const Instr &instr : code_)
+        {
+            h = (h ^ (std::uint64_t)instr.op) * 1099511628211ull;
+            h = (h ^ (std::uint32_t)instr.arg) * 1099511628211ull;
+        }
+        return h;
+    }
+
+    // Rewrites the code into an equivalent one without dead weight:
+    // constant operations are folded, identities (x + 0, x - 0, x * 1) and
+    // annihilators (x * 0, x - x) dropped, and the operands of + and * put
+    // in a canonical order, shorter first, which brings constants to the
+    // front so that they also merge across nested + or *. The arithmetic
+    // wraps, so every rule is exact and the sequence stays the same.
+    void simplify() { simplify_in<WrappingArithmetic>(); }
+
+    // The same for another domain. Constants are folded in it, and only
+    // to a value an int stands for there. Where the domain rejects an
+    // overflow, annihilators and merges across nested operations are left
+    // alone: they would drop or move an operation that may be the one to
+    // overflow, and simplification would decide which programs are valid.
+    template <class Arithmetic>
+    void simplify_in();
+
+    // Term i of seq from the ones before it, `sum` being their sum.
+    int run(const int *seq, std::size_t i, int sum) const;
+
+    // Fills seq[2..count-1] from the two seed terms in seq[0] and seq[1].
+    void run_sequence(int *seq, std::size_t count) const;
+
+    // run_sequence and the squared error against target[2..count-1] in one
+    // pass. Stops at the first term that takes the error past `limit`; the
+    // result is then a lower bound and the rest of seq is not filled.
+    std::uint64_t run_scored(int *seq, const int *target, std::size_t count, std::uint64_t limit = UINT64_MAX) const;
+
+    // Both in another arithmetic domain, see arithmetic.h, seq holding its
+    // values, from the `first` seed terms, at least lookback(). A term the
+    // domain cannot hold ends the run: run_sequence_in then returns false,
+    // run_scored_in the error UINT64_MAX.
+    template <class Arithmetic>
+    bool run_sequence_in(typename Arithmetic::value_type *seq, std::size_t count, std::size_t first = 2) const;
+    template <class Arithmetic>
+    std::uint64_t run_scored_in(typename Arithmetic::value_type *seq, const int *target, std::size_t count,
+        std::uint64_t limit = UINT64_MAX, std::size_t first = 2) const;
+
+private:
+    friend class StagedProgram;
+
+    static constexpr std::size_t small_stack = 32;
+
+    // Code of a subtree on the simplification stack; `lhs` is the length
+    // of the left operand of its root, 0 for a leaf.
+    struct Operand
+    {
+        std::size_t start;
+        std::size_t lhs;
+    };
+
+    int exec(int *stack, std::size_t n, const int *history, int sum) const
+    {
+        int result;
+        exec_code<WrappingArithmetic, false>(code_.data(), code_.data() + code_.size(), stack, n, history, sum, nullptr, 0,
+            result);
+        return result;
+    }
+
+    // The sum of seq[0..first-1], false if the domain cannot hold it.
+    template <class Arithmetic>
+    static bool seed_sum(const typename Arithmetic::value_type *seq, std::size_t first,
+        typename Arithmetic::value_type &sum);
+
+    // False if an operation fails in the domain. The terms before the
+    // current one end at `history`, and `sum` is their sum. With
+    // `Columns`, N loads columns[arg * stride] instead: the step code of a
+    // StagedProgram.
+    template <class Arithmetic, bool Columns>
+    static bool exec_code(const Instr *ip, const Instr *end, typename Arithmetic::value_type *stack, std::size_t n,
+        const typename Arithmetic::value_type *history, typename Arithmetic::value_type sum,
+        const typename Arithmetic::value_type *columns, std::size_t stride, typename Arithmetic::value_type &result);
+
+    static bool is_leaf(OpCode op) noexcept { return op < OpCode::Plus; }
+    // `lhs op rhs` in the domain into `out`, false if it fails or no int
+    // stands for the result.
+    template <class Arithmetic>
+    static bool fold(OpCode op, int lhs, int rhs, int &out) noexcept;
+    bool is_constant(std::size_t start, std::size_t end, int &value) const noexcept;
+    int compare(std::size_t lhs, std::size_t rhs, std::size_t end) const noexcept;
+    std::size_t left_length(std::size_t start, std::size_t end) const noexcept;
+    template <class Arithmetic>
+    std::size_t reduce(Operand *operands, std::size_t top, std::size_t end, OpCode op);
+    void recount_depth() noexcept;
+
+    std::vector<Instr> code_;
+    std::size_t depth_ = 0;
+    std::size_t max_depth_ = 0;
+};
+
+// The top of the stack lives in `acc`, so a leaf costs one store and an
+// operation one load. GCC and Clang get a computed-goto dispatch loop,
+// everything else a plain switch.
+template <class Arithmetic, bool Columns>
+inline bool Program::exec_code(const Instr *ip, const Instr *end, typename Arithmetic::value_type *stack, std::size_t n,
+    const typename Arithmetic::value_type *history, typename Arithmetic::value_type sum,
+    const typename Arithmetic::value_type *columns, std::size_t stride, typename Arithmetic::value_type &result)
+{
+    using Value = typename Arithmetic::value_type;
+    Value *sp = stack;
+    Value acc = 0;
+#if defined(__GNUC__)
+    static void *const labels[] = { &&op_value, &&op_n, &&op_xp, &&op_xpp, &&op_lag, &&op_sum, &&op_plus, &&op_minus,
+        &&op_mul };
+#define SEQGEN_DISPATCH() if (ip == end) { result = acc; return true; } goto *labels[(std::size_t)(ip++)->op]
+    SEQGEN_DISPATCH();
+op_value:
+    *sp++ = acc;
+    acc = Arithmetic::from_int(ip[-1].arg);
+    SEQGEN_DISPATCH();
+op_n:
+    *sp++ = acc;
+    acc = Columns ? columns[ip[-1].arg * stride] : Arithmetic::from_int((int)n);
+    SEQGEN_DISPATCH();
+op_xp:
+    *sp++ = acc;
+    acc = history[-1];
+    SEQGEN_DISPATCH();
+op_xpp:
+    *sp++ = acc;
+    acc = history[-2];
+    SEQGEN_DISPATCH();
+op_lag:
+    *sp++ = acc;
+    acc = history[-ip[-1].arg];
+    SEQGEN_DISPATCH();
+op_sum:
+    *sp++ = acc;
+    acc = sum;
+    SEQGEN_DISPATCH();
+op_plus:
+    if (!Arithmetic::add(*--sp, acc, acc))
+    {
+        return false;
+    }
+    SEQGEN_DISPATCH();
+op_minus:
+    if (!Arithmetic::sub(*--sp, acc, acc))
+    {
+        return false;
+    }
+    SEQGEN_DISPATCH();
+op_mul:
+    if (!Arithmetic::mul(*--sp, acc, acc))
+    {
+        return false;
+    }
+    SEQGEN_DISPATCH();
+#undef SEQGEN_DISPATCH
+#else
+    for (; ip != end; ++ip)
+    {
+        bool ok = true;
+        switch (ip->op)
+        {
+        case OpCode::Value:
+            *sp++ = acc;
+            acc = Arithmetic::from_int(ip->arg);
+            break;
+        case OpCode::N:
+            *sp++ = acc;
+            acc = Columns ? columns[ip->arg * stride] : Arithmetic::from_int((int)n);
+            break;
+        case OpCode::XP:
+            *sp++ = acc;
+            acc = history[-1];
+            break;
+        case OpCode::XPP:
+            *sp++ = acc;
+            acc = history[-2];
+            break;
+        case OpCode::Lag:
+            *sp++ = acc;
+            acc = history[-ip->arg];
+            break;
+        case OpCode::Sum:
+            *sp++ = acc;
+            acc = sum;
+            break;
+        case OpCode::Plus:
+            ok = Arithmetic::add(*--sp, acc, acc);
+            break;
+        case OpCode::Minus:
+            ok = Arithmetic::sub(*--sp, acc, acc);
+            break;
+        case OpCode::Mul:
+            ok = Arithmetic::mul(*--sp, acc, acc);
+            break;
+        }
+        if (!ok)
+        {
+            return false;
+        }
+    }
+    result = acc;
+    return true;
+#endif
+}
+
+inline int Program::run(const int *seq, std::size_t i, int sum) const
+{
+    int stack[small_stack];
+    if (max_depth_ > small_stack)
+    {
+        std::vector<int> big_stack(max_depth_);
+        return exec(big_stack.data(), i + 1, seq + i, sum);
+    }
+    return exec(stack, i + 1, seq + i, sum);
+}
+
+template <class Arithmetic>
+inline bool Program::seed_sum(const typename Arithmetic::value_type *seq, std::size_t first,
+    typename Arithmetic::value_type &sum)
+{
+    sum = Arithmetic::from_int(0);
+    for (std::size_t i = 0; i < first; i++)
+    {
+        if (!Arithmetic::add(sum, seq[i], sum))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline void Program::run_sequence(int *seq, std::size_t count) const
+{
+    int small[small_stack];
+    std::vector<int> big_stack;
+    int *stack = small;
+    if (max_depth_ > small_stack)
+    {
+        big_stack.resize(max_depth_);
+        stack = big_stack.data();
+    }
+    int sum = wrapping_add(seq[0], seq[1]);
+    for (std::size_t i = 2; i < count; i++)
+    {
+        seq[i] = exec(stack, i + 1, seq + i, sum);
+        sum = wrapping_add(sum, seq[i]);
+    }
+}
+
+inline std::uint64_t Program::run_scored(int *seq, const int *target, std::size_t count, std::uint64_t limit) const
+{
+    int small[small_stack];
+    std::vector<int> big_stack;
+    int *stack = small;
+    if (max_depth_ > small_stack)
+    {
+        big_stack.resize(max_depth_);
+        stack = big_stack.data();
+    }
+    std::uint64_t error = 0;
+    int sum = wrapping_add(seq[0], seq[1]);
+    for (std::size_t i = 2; i < count && error <= limit; i++)
+    {
+        seq[i] = exec(stack, i + 1, seq + i, sum);
+        sum = wrapping_add(sum, seq[i]);
+        error = saturating_add(error, squared_diff(seq[i], target[i]));
+    }
+    return error;
+}
+
+template <class Arithmetic>
+inline bool Program::run_sequence_in(typename Arithmetic::value_type *seq, std::size_t count, std::size_t first) const
+{
+    using Value = typename Arithmetic::value_type;
+    Value small[small_stack];
+    std::vector<Value> big_stack;
+    Value *stack = small;
+    if (max_depth_ > small_stack)
+    {
+        big_stack.resize(max_depth_);
+        stack = big_stack.data();
+    }
+    // A sum the domain cannot hold only ends the runs that read it.
+    const bool sums = reads_sum();
+    Value sum = Arithmetic::from_int(0);
+    if (sums && !seed_sum<Arithmetic>(seq, first, sum))
+    {
+        return false;
+    }
+    for (std::size_t i = first; i < count; i++)
+    {
+        if (!exec_code<Arithmetic, false>(code_.data(), code_.data() + code_.size(), stack, i + 1, seq + i, sum,
+                nullptr, 0, seq[i]) || (sums && !Arithmetic::add(sum, seq[i], sum)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <class Arithmetic>
+inline std::uint64_t Program::run_scored_in(typename Arithmetic::value_type *seq, const int *target, std::size_t count,
+    std::uint64_t limit, std::size_t first) const
+{
+    using Value = typename Arithmetic::value_type;
+    Value small[small_stack];
+    std::vector<Value> big_stack;
+    Value *stack = small;
+    if (max_depth_ > small_stack)
+    {
+        big_stack.resize(max_depth_);
+        stack = big_stack.data();
+    }
+    std::uint64_t error = 0;
+    const bool sums = reads_sum();
+    Value sum = Arithmetic::from_int(0);
+    if (sums && !seed_sum<Arithmetic>(seq, first, sum))
+    {
+        return UINT64_MAX;
+    }
+    for (std::size_t i = first; i < count && error <= limit; i++)
+    {
+        if (!exec_code<Arithmetic, false>(code_.data(), code_.data() + code_.size(), stack, i + 1, seq + i, sum,
+                nullptr, 0, seq[i]) || (sums && !Arithmetic::add(sum, seq[i], sum)))
+        {
+            return UINT64_MAX;
+        }
+        error = saturating_add(error, Arithmetic::squared_error(seq[i], target[i]));
+    }
+    return error;
+}
+
+template <class Arithmetic>
+inline bool Program::fold(OpCode op, int lhs, int rhs, int &out) noexcept
+{
+    using Value = typename Arithmetic::value_type;
+    const Value a = Arithmetic::from_int(lhs);
+    const Value b = Arithmetic::from_int(rhs);
+    Value value;
+    bool ok;
+    switch (op)
+    {
+    case OpCode::Plus:
+        ok = Arithmetic::add(a, b, value);
+        break;
+    case OpCode::Minus:
+        ok = Arithmetic::sub(a, b, value);
+        break;
+    default:
+        ok = Arithmetic::mul(a, b, value);
+        break;
+    }
+    if (!ok || Arithmetic::from_int((int)value) != value)
+    {
+        return false;
+    }
+    out = (int)value;
+    return true;
+}
+
+inline bool Program::is_constant(std::size_t start, std::size_t end, int &value) const noexcept
+{
+    if (end - start != 1 || code_[start].op != OpCode::Value)
+    {
+        return false;
+    }
+    value = code_[start].arg;
+    return true;
+}
+
+// Canonical order of the operands code_[lhs, rhs) and code_[rhs, end):
+// by length, then instruction by instruction.
+inline int Program::compare(std::size_t lhs, std::size_t rhs, std::size_t end) const noexcept
+{
+    const std::size_t lhs_size = rhs - lhs;
+    const std::size_t rhs_size = end - rhs;
+    if (lhs_size != rhs_size)
+    {
+        return lhs_size < rhs_size ? -1 : 1;
+    }
+    for (std::size_t i = 0; i < lhs_size; i++)
+    {
+        const Instr &l = code_[lhs + i];
+        const Instr &r = code_[rhs + i];
+        if (l.op != r.op)
+        {
+            return l.op < r.op ? -1 : 1;
+        }
+        if (l.arg != r.arg)
+        {
+            return l.arg < r.arg ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// Length of the left operand of the operation ending at code_[end - 1]:
+// the right one is the shortest complete subtree before it.
+inline std::size_t Program::left_length(std::size_t start, std::size_t end) const noexcept
+{
+    if (end - start == 1)
+    {
+        return 0;
+    }
+    std::size_t p = end - 1;
+    std::size_t need = 1;
+    while (need != 0)
+    {
+        --p;
+        need = is_leaf(code_[p].op) ? need - 1 : need + 1;
+    }
+    return p - start;
+}
+
+// Applies `op` to the two operands on top of the simplification stack,
+// whose code ends the output at `end`, and returns the new end.
+template <class Arithmetic>
+inline std::size_t Program::reduce(Operand *operands, std::size_t top, std::size_t end, OpCode op)
+{
+    Instr *const code = code_.data();
+    Operand &lhs = operands[top - 2];
+    Operand rhs = operands[top - 1];
+    const std::size_t l = lhs.start;
+    while (true)
+    {
+        const std::size_t r = rhs.start;
+        int a = 0, b = 0;
+        const bool lhs_constant = is_constant(l, r, a);
+        const bool rhs_constant = is_constant(r, end, b);
+        int folded = 0;
+        bool constant = lhs_constant && rhs_constant && fold<Arithmetic>(op, a, b, folded);
+        bool keep_lhs = false, keep_rhs = false;
+        switch (op)
+        {
+        case OpCode::Plus:
+            keep_rhs = lhs_constant && a == 0;
+            keep_lhs = rhs_constant && b == 0;
+            break;
+        case OpCode::Minus:
+            keep_lhs = rhs_constant && b == 0;
+            constant = constant || (!Arithmetic::can_fail && compare(l, r, end) == 0);
+            break;
+        default:
+            constant = constant || (!Arithmetic::can_fail && ((lhs_constant && a == 0) || (rhs_constant && b == 0)));
+            keep_rhs = lhs_constant && a == 1;
+            keep_lhs = rhs_constant && b == 1;
+            break;
+        }
+        if (constant)
+        {
+            // Folds to a constant, 0 for the annihilators.
+            code[l] = Instr{ OpCode::Value, folded };
+            lhs.lhs = 0;
+            return l + 1;
+        }
+        if (keep_lhs)
+        {
+            return r;
+        }
+        if (keep_rhs)
+        {
+            std::copy(code + r, code + end, code + l);
+            lhs.lhs = rhs.lhs;
+            return end - 1;
+        }
+        std::size_t left = r - l;
+        std::size_t right_lhs = rhs.lhs;
+        if (op != OpCode::Minus && compare(l, r, end) > 0)
+        {
+            std::rotate(code + l, code + r, code + end);
+            left = end - r;
+            right_lhs = lhs.lhs;
+        }
+        // (op a (op b x)) is (op (a op b) x), and x may simplify further
+        // against the merged constant.
+        int merged;
+        if (!Arithmetic::can_fail && op != OpCode::Minus && is_constant(l, l + left, a) && code[end - 1].op == op &&
+            right_lhs == 1 && code[l + 1].op == OpCode::Value && fold<Arithmetic>(op, a, code[l + 1].arg, merged))
+        {
+            code[l].arg = merged;
+            std::copy(code + l + 2, code + end - 1, code + l + 1);
+            end -= 2;
+            lhs.lhs = 0;
+            rhs = Operand{ l + 1, left_length(l + 1, end) };
+            continue;
+        }
+        code[end] = Instr{ op, 0 };
+        lhs.lhs = left;
+        return end + 1;
+    }
+}
+
+inline void Program::recount_depth() noexcept
+{
+    depth_ = 0;
+    max_depth_ = 0;
+    for (const Instr &instr : code_)
+    {
+        if (is_leaf(instr.op))
+        {
+            if (++depth_ > max_depth_)
+            {
+                max_depth_ = depth_;
+            }
+        }
+        else
+        {
+            --depth_;
+        }
+    }
+}
+
+// In place: the output never runs ahead of the input.
+template <class Arithmetic>
+inline void Program::simplify_in()
+{
+    Operand small[small_stack];
+    std::vector<Operand> big;
+    Operand *operands = small;
+    if (max_depth_ > small_stack)
+    {
+        big.resize(max_depth_);
+        operands = big.data();
+    }
+    std::size_t top = 0;
+    std::size_t end = 0;
+    for (std::size_t i = 0; i < code_.size(); i++)
+    {
+        const Instr instr = code_[i];
+        if (is_leaf(instr.op))
+        {
+            operands[top++] = Operand{ end, 0 };
+            code_[end++] = instr;
+        }
+        else
+        {
+            end = reduce<Arithmetic>(operands, top--, end, instr.op);
+        }
+    }
+    code_.resize(end);
+    recount_depth();
+}
+
+// A Program split by what its subtrees depend on. A subtree that reads no
+// earlier term gives the same values whatever the recurrence does,
+// so each largest such subtree is computed once per run as a column over
+// all the steps, an instruction at a time in a loop over n the compiler
+// vectorizes. The step loop only interprets what is left, the path from
+// the root down to the recursive leaves, with each column standing in as
+// one leaf. A formula in N alone has no step code at all.
+//
+// The arithmetic is the same as Program's, so both give the same
+// sequence. Staging pays off on the interpreter, which dispatches every
+// instruction on every step; batches of programs already share the
+// dispatch between SIMD lanes.
+class StagedProgram
+{
+public:
+    // Refers to the code of `program`, which has to outlive the runs.
+    void build(const Program &program);
+
+    // Instructions left in the step loop, and whether there are any.
+    std::size_t step_size() const noexcept { return steps_; }
+    bool recursive() const noexcept { return steps_ != 0; }
+
+    // As Program::run_sequence and Program::run_scored.
+    void run_sequence(int *seq, std::size_t count);
+    std::uint64_t run_scored(int *seq, const int *target, std::size_t count, std::uint64_t limit = UINT64_MAX);
+
+private:
+    // A subtree being staged: where its code starts in the program and,
+    // if it reads earlier terms, where its step code starts.
+    struct Subtree
+    {
+        std::size_t start;
+        bool recurrent;
+        std::size_t step_start;
+    };
+
+    // Code of a column in the program.
+    struct Column
+    {
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    // The step code standing for the subtree source_[start, end): the
+    // constant of a leaf, or a new column.
+    Instr closed(std::size_t start, std::size_t end)
+    {
+        if (end - start == 1 && source_[start].op == OpCode::Value)
+        {
+            return source_[start];
+        }
+        columns_code_.push_back(Column{ start, end });
+        return Instr{ OpCode::N, (int)columns_code_.size() - 1 };
+    }
+
+    void compute_columns(std::size_t count);
+    int step(const int *seq, std::size_t i, int sum)
+    {
+        int result;
+        Program::exec_code<WrappingArithmetic, true>(step_.data(), step_.data() + steps_, stack_.data(), 0, seq + i, sum,
+            columns_.data() + i, stride_, result);
+        return result;
+    }
+
+    const Instr *source_ = nullptr;
+    std::vector<Column> columns_code_;
+    // Step code, N standing for column `arg`, in the first steps_.
+    std::vector<Instr> step_;
+    std::size_t steps_ = 0;
+    std::size_t depth_ = 0;
+    std::vector<Subtree> pending_;
+
+    // Run scratch: column k at columns_[k * stride_], indexed by step.
+    std::vector<int> columns_;
+    std::vector<int> scratch_;
+    std::vector<int> stack_;
+    std::size_t stride_ = 0;
+};
+
+// One pass over the postfix code. Subtrees without earlier terms are only
+// turned into step code once an operation joins them with one that has
+// them; a left one then goes in front of the step code of its sibling.
+inline void StagedProgram::build(const Program &program)
+{
+    const std::vector<Instr> &code = program.code();
+    source_ = code.data();
+    columns_code_.clear();
+    depth_ = program.stack_depth();
+    if (stack_.size() <= depth_)
+    {
+        stack_.resize(depth_ + 1);
+        pending_.resize(depth_ + 1);
+    }
+    if (step_.size() < code.size())
+    {
+        step_.resize(code.size());
+    }
+    Subtree *top = pending_.data();
+    Instr *const out = step_.data();
+    std::size_t steps = 0;
+    for (std::size_t p = 0; p < code.size(); p++)
+    {
+        const Instr instr = code[p];
+        if (Program::is_leaf(instr.op))
+        {
+            const bool recurrent = instr.op != OpCode::Value && instr.op != OpCode::N;
+            *top++ = Subtree{ p, recurrent, steps };
+            if (recurrent)
+            {
+                out[steps++] = instr;
+            }
+            continue;
+        }
+        const Subtree rhs = *--top;
+        Subtree &lhs = top[-1];
+        if (!lhs.recurrent && !rhs.recurrent)
+        {
+            continue;
+        }
+        if (!lhs.recurrent)
+        {
+            std::copy_backward(out + rhs.step_start, out + steps, out + steps + 1);
+            out[rhs.step_start] = closed(lhs.start, rhs.start);
+            steps++;
+            lhs.step_start = rhs.step_start;
+        }
+        if (!rhs.recurrent)
+        {
+            out[steps++] = closed(rhs.start, p);
+        }
+        lhs.recurrent = true;
+        out[steps++] = instr;
+    }
+    steps_ = steps;
+    if (top != pending_.data() && !top[-1].recurrent)
+    {
+        // The whole formula is column 0.
+        columns_code_.push_back(Column{ 0, code.size() });
+    }
+}
+
+// Columns hold the steps at their own index. They run on to a whole
+// number of vectors, so the loops have no remainder to deal with.
+inline void StagedProgram::compute_columns(std::size_t count)
+{
+    count = (count + 7) & ~std::size_t(7);
+    stride_ = count;
+    columns_.resize(columns_code_.size() * count);
+    scratch_.resize(depth_ * count);
+    for (std::size_t k = 0; k < columns_code_.size(); k++)
+    {
+        std::size_t top = 0;
+        for (std::size_t p = columns_code_[k].begin; p < columns_code_[k].end; p++)
+        {
+            const Instr instr = source_[p];
+            if (Program::is_leaf(instr.op))
+            {
+                int *const dst = scratch_.data() + top++ * count;
+                if (instr.op == OpCode::N)
+                {
+                    for (std::size_t i = 0; i < count; i++)
+                    {
+                        dst[i] = (int)(i + 1);
+                    }
+                }
+                else
+                {
+                    std::fill(dst, dst + count, instr.arg);
+                }
+                continue;
+            }
+            top--;
+            int *const dst = scratch_.data() + (top - 1) * count;
+            const int *const src = scratch_.data() + top * count;
+            switch (instr.op)
+            {
+            case OpCode::Plus:
+                for (std::size_t i = 0; i < count; i++)
+                {
+                    dst[i] = wrapping_add(dst[i], src[i]);
+                }
+                break;
+            case OpCode::Minus:
+                for (std::size_t i = 0; i < count; i++)
+                {
+                    dst[i] = wrapping_sub(dst[i], src[i]);
+                }
+                break;
+            default:
+                for (std::size_t i = 0; i < count; i++)
+                {
+                    dst[i] = wrapping_mul(dst[i], src[i]);
+                }
+                break;
+            }
+        }
+        std::copy(scratch_.begin(), scratch_.begin() + count, columns_.begin() + k * count);
+    }
+}
+
+inline void StagedProgram::run_sequence(int *seq, std::size_t count)
+{
+    compute_columns(count);
+    const bool recursive = this->recursive();
+    int sum = wrapping_add(seq[0], seq[1]);
+    for (std::size_t i = 2; i < count; i++)
+    {
+        seq[i] = recursive ? step(seq, i, sum) : columns_[i];
+        sum = wrapping_add(sum, seq[i]);
+    }
+}
+
+inline std::uint64_t StagedProgram::run_scored(int *seq, const int *target, std::size_t count, std::uint64_t limit)
+{
+    compute_columns(count);
+    const bool recursive = this->recursive();
+    std::uint64_t error = 0;
+    int sum = wrapping_add(seq[0], seq[1]);
+    for (std::size_t i = 2; i < count && error <= limit; i++)
+    {
+        seq[i] = recursive ? step(seq, i, sum) : columns_[i];
+        sum = wrapping_add(sum, seq[i]);
+        error = saturating_add(error, squared_diff(seq[i], target[i]));
+    }
+    return error;
+}
+
+#endif  // BYTECODE_H
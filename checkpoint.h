@@ -0,0 +1,335 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+// Binary checkpoints of a search, written in the background and read back
+// through a read-only mapping.
+//
+// A checkpoint file is, in host byte order:
+//   u32 magic "SGCP", u32 version
+//   u64 seed, u64 next generation, u64 error limit
+//   u32 lookback, u8 1 if the search reads prefix sums
+//   u32 target length, i32 terms
+//   u32 population size, the trees one after the other
+//   u32 fitness cache generation, u64 entries,
+//       u64 key, u64 error, u64 fingerprint, u32 last seen each
+//   u64 FNV-1a hash of everything before it
+//
+// A tree is its nodes in prefix order, a byte each:
+//   0..2    operation +, -, *, followed by its two operands
+//   3..5    variable N, XP, XPP
+//   6       any constant, its zigzag varint following
+//   7       lag, how many terms back as a varint following
+//   8       sum of the terms so far
+//   9..255  constant 0..246
+// so the trees the search breeds take one byte per node. A reader knows
+// where a tree ends by counting the operands still missing.
+//
+// Files are written next to their final path and renamed over it, so a
+// search killed while writing leaves the previous checkpoint intact.
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace checkpoint_format
+{
+
+constexpr std::uint32_t magic = 0x50434753;  // "SGCP"
+constexpr std::uint32_t version = 2;
+
+constexpr std::uint8_t operation = 0;
+constexpr std::uint8_t variable = 3;
+constexpr std::uint8_t any_constant = 6;
+constexpr std::uint8_t lag = 7;
+constexpr std::uint8_t sum = 8;
+constexpr std::uint8_t small_constant = 9;
+constexpr int max_small_constant = 255 - small_constant;
+
+inline std::uint64_t fnv1a(const std::uint8_t *data, std::size_t size)
+{
+    std::uint64_t hash = 14695981039346656037ull;
+    for (std::size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+}  // namespace checkpoint_format
+
+class ByteWriter
+{
+public:
+    void put_u8(std::uint8_t value) { bytes_.push_back(value); }
+    void put_u32(std::uint32_t value) { put(&value, sizeof(value)); }
+    void put_u64(std::uint64_t value) { put(&value, sizeof(value)); }
+    void put_i32(std::int32_t value) { put(&value, sizeof(value)); }
+
+    // Zigzag: small magnitudes of either sign take one byte.
+    void put_varint(std::int64_t value)
+    {
+        std::uint64_t bits = ((std::uint64_t)value << 1) ^ (std::uint64_t)(value >> 63);
+        while (bits >= 0x80)
+        {
+            bytes_.push_back((std::uint8_t)(bits | 0x80));
+            bits >>= 7;
+        }
+        bytes_.push_back((std::uint8_t)bits);
+    }
+
+    std::vector<std::uint8_t>& bytes() noexcept { return bytes_; }
+
+private:
+    void put(const void *data, std::size_t size)
+    {
+        const std::uint8_t *p = static_cast<const std::uint8_t*>(data);
+        bytes_.insert(bytes_.end(), p, p + size);
+    }
+
+    std::vector<std::uint8_t> bytes_;
+};
+
+// Throws std::runtime_error on reading past the end.
+class ByteReader
+{
+public:
+    ByteReader(const std::uint8_t *data, std::size_t size) : p_(data), end_(data + size) {}
+
+    std::uint8_t get_u8()
+    {
+        need(1);
+        return *p_++;
+    }
+
+    std::uint32_t get_u32() { return get<std::uint32_t>(); }
+    std::uint64_t get_u64() { return get<std::uint64_t>(); }
+    std::int32_t get_i32() { return get<std::int32_t>(); }
+
+    std::int64_t get_varint()
+    {
+        std::uint64_t bits = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            const std::uint8_t byte = get_u8();
+            bits |= (std::uint64_t)(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                return (std::int64_t)(bits >> 1) ^ -(std::int64_t)(bits & 1);
+            }
+        }
+        throw std::runtime_error("checkpoint: bad varint");
+    }
+
+    std::size_t remaining() const noexcept { return (std::size_t)(end_ - p_); }
+
+private:
+    void need(std::size_t size) const
+    {
+        if (remaining() < size)
+        {
+            throw std::runtime_error("checkpoint: truncated file");
+        }
+    }
+
+    template <class T>
+    T get()
+    {
+        need(sizeof(T));
+        T value;
+        std::memcpy(&value, p_, sizeof(T));
+        p_ += sizeof(T);
+        return value;
+    }
+
+    const std::uint8_t *p_;
+    const std::uint8_t *end_;
+};
+
+// A whole file mapped read-only.
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &path)
+    {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("cannot open " + path);
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("cannot stat " + path);
+        }
+        size_ = (std::size_t)st.st_size;
+        if (size_ != 0)
+        {
+            void *memory = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (memory == MAP_FAILED)
+            {
+                close(fd);
+                throw std::runtime_error("cannot map " + path);
+            }
+            data_ = static_cast<const std::uint8_t*>(memory);
+        }
+        close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        if (data_ != nullptr)
+        {
+            munmap(const_cast<std::uint8_t*>(data_), size_);
+        }
+    }
+
+    const std::uint8_t* data() const noexcept { return data_; }
+    std::size_t size() const noexcept { return size_; }
+
+private:
+    const std::uint8_t *data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+// Writes files on a thread of its own. A checkpoint submitted while the
+// previous one is still being written is dropped rather than waited for,
+// so the search never stalls on the disk. The destructor waits for the
+// write in flight.
+class CheckpointWriter
+{
+public:
+    CheckpointWriter() : thread_([this] { run(); }) {}
+
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+    ~CheckpointWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    // `encode` runs on the writer thread and returns the file contents.
+    // False if the writer was busy and the checkpoint was dropped.
+    template <class F>
+    bool submit(const std::string &path, F &&encode)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (pending_)
+            {
+                return false;
+            }
+            path_ = path;
+            encode_ = std::forward<F>(encode);
+            pending_ = true;
+        }
+        wake_.notify_one();
+        return true;
+    }
+
+    bool busy() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pending_;
+    }
+
+    // Checkpoints written, and those that failed to be.
+    std::uint64_t written() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return written_;
+    }
+
+    std::uint64_t failed() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return failed_;
+    }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            wake_.wait(lock, [this] { return stop_ || pending_; });
+            if (!pending_)
+            {
+                return;
+            }
+            const std::string path = path_;
+            auto encode = std::move(encode_);
+            lock.unlock();
+            bool ok = false;
+            try
+            {
+                ok = write_file(path, encode());
+            }
+            catch (const std::exception&)
+            {
+            }
+            lock.lock();
+            (ok ? written_ : failed_)++;
+            pending_ = false;
+        }
+    }
+
+    static bool write_file(const std::string &path, const std::vector<std::uint8_t> &bytes)
+    {
+        const std::string temp = path + ".tmp";
+        const int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            return false;
+        }
+        std::size_t done = 0;
+        while (done < bytes.size())
+        {
+            const ssize_t n = write(fd, bytes.data() + done, bytes.size() - done);
+            if (n <= 0)
+            {
+                close(fd);
+                return false;
+            }
+            done += (std::size_t)n;
+        }
+        const bool synced = fsync(fd) == 0;
+        close(fd);
+        return synced && rename(temp.c_str(), path.c_str()) == 0;
+    }
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::string path_;
+    std::function<std::vector<std::uint8_t>()> encode_;
+    bool pending_ = false;
+    bool stop_ = false;
+    std::uint64_t written_ = 0;
+    std::uint64_t failed_ = 0;
+    std::thread thread_;
+};
+
+#endif  // CHECKPOINT_H
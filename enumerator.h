@@ -0,0 +1,378 @@
+#ifndef ENUMERATOR_H
+#define ENUMERATOR_H
+
+// Bottom-up enumeration of recurrence formulas, smallest first, keeping
+// one expression per observational equivalence class.
+//
+// An expression is judged by its values at the points of the target:
+// term i is computed from n = i + 1 and the target's own terms i - 1 and
+// i - 2, for i from 2. An expression giving every term at these points
+// gives the whole target when run from its first two terms. Two
+// expressions with the same values are interchangeable inside any larger
+// one, since the operations work point by point, so the bank keeps the
+// first expression found for each vector of values and builds those of
+// size s only out of banked ones whose sizes add up to s - 1.
+//
+// A size is enumerated in rounds of rows, a row being one left operand
+// against every right one. Workers compute the rows of a round in
+// parallel and look their results up in the bank as it was when the round
+// started; what is new is added after the round, in row order, so neither
+// the bank nor the expression found depend on the number of workers.
+//
+// Once the bank is as large as its memory limit allows it is frozen:
+// larger expressions are still built out of it and checked against the
+// target, but no longer kept, and the search is no longer exhaustive.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "bytecode.h"
+#include "rng.h"
+#include "thread_pool.h"
+
+class BottomUpEnumerator
+{
+public:
+    // Operations in the order of OperationType.
+    enum Op : std::uint8_t { plus, minus, mul, leaf = 255 };
+
+    // How an expression is built: an operation on two banked expressions,
+    // or for a leaf the index of its values in the constructor's `leaves`.
+    struct Origin
+    {
+        std::uint8_t op;
+        std::uint32_t left;
+        std::uint32_t right;
+    };
+
+    // `target` holds the values wanted at each point, and every leaf its
+    // values there.
+    BottomUpEnumerator(std::vector<std::vector<int>> leaves, std::vector<int> target, std::size_t memory_limit)
+        : leaves_(std::move(leaves)), target_(std::move(target)), points_(target_.size())
+    {
+        // Values, origin and hash of an entry, and the table at worst a
+        // quarter full.
+        const std::size_t entry_bytes = points_ * sizeof(int) + sizeof(Origin) + sizeof(std::uint32_t) + 4 * sizeof(std::uint32_t);
+        max_entries_ = std::min<std::size_t>(memory_limit / entry_bytes, UINT32_MAX - 1);
+    }
+
+    BottomUpEnumerator(const BottomUpEnumerator&) = delete;
+    BottomUpEnumerator& operator=(const BottomUpEnumerator&) = delete;
+
+    // Goes through the expressions of up to `max_size` nodes until one
+    // gives the target; false if none does.
+    bool run(std::size_t max_size, ThreadPool &pool)
+    {
+        levels_.assign(max_size + 1, std::make_pair(0u, 0u));
+        scratch_.assign(pool.size(), std::vector<int>(points_));
+        if (max_size == 0)
+        {
+            return false;
+        }
+
+        const std::uint32_t first = (std::uint32_t)origins_.size();
+        for (std::size_t i = 0; i < leaves_.size(); i++)
+        {
+            candidates_++;
+            const Origin origin{ leaf, (std::uint32_t)i, 0 };
+            if (leaves_[i] == target_)
+            {
+                match_ = origin;
+                return true;
+            }
+            insert(origin, leaves_[i].data());
+        }
+        levels_[1] = std::make_pair(first, (std::uint32_t)origins_.size());
+
+        for (std::size_t size = 3; size <= max_size; size += 2)
+        {
+            const std::uint32_t begin = (std::uint32_t)origins_.size();
+            for (std::uint8_t op : { plus, minus, mul })
+            {
+                for (std::size_t left = 1; left + 1 < size; left += 2)
+                {
+                    const std::size_t right = size - 1 - left;
+                    // a + b and b + a compute the same; only one is built.
+                    if (op != minus && left > right)
+                    {
+                        continue;
+                    }
+                    if (run_segment(op, levels_[left], levels_[right], op != minus && left == right, pool))
+                    {
+                        return true;
+                    }
+                }
+            }
+            levels_[size] = std::make_pair(begin, (std::uint32_t)origins_.size());
+        }
+        return false;
+    }
+
+    // Of the expression run() found.
+    const Origin& match() const noexcept { return match_; }
+    // Of a banked expression, named by the Origin of another.
+    const Origin& origin(std::uint32_t id) const { return origins_[id]; }
+
+    // Expressions built, and distinct ones kept.
+    std::uint64_t candidates() const noexcept { return candidates_; }
+    std::size_t bank_size() const noexcept { return origins_.size(); }
+    bool frozen() const noexcept { return frozen_; }
+    // Bytes the bank holds.
+    std::size_t memory() const noexcept
+    {
+        return values_.capacity() * sizeof(int) + origins_.capacity() * sizeof(Origin) +
+            hashes_.capacity() * sizeof(std::uint32_t) + table_.capacity() * sizeof(std::uint32_t);
+    }
+
+private:
+    using Range = std::pair<std::uint32_t, std::uint32_t>;
+
+    // Output of a run of consecutive rows: the first match among them and
+    // the expressions the bank did not know.
+    struct Chunk
+    {
+        bool matched;
+        Origin match;
+        std::uint64_t candidates;
+        std::vector<Origin> fresh;
+    };
+
+    // Combinations per round.
+    static constexpr std::size_t round_candidates = std::size_t(1) << 18;
+
+    static void apply(std::uint8_t op, const int *lhs, const int *rhs, int *out, std::size_t points)
+    {
+        switch (op)
+        {
+        case plus:
+            for (std::size_t i = 0; i < points; i++)
+            {
+                out[i] = wrapping_add(lhs[i], rhs[i]);
+            }
+            break;
+        case minus:
+            for (std::size_t i = 0; i < points; i++)
+            {
+                out[i] = wrapping_sub(lhs[i], rhs[i]);
+            }
+            break;
+        default:
+            for (std::size_t i = 0; i < points; i++)
+            {
+                out[i] = wrapping_mul(lhs[i], rhs[i]);
+            }
+            break;
+        }
+    }
+
+    static std::uint64_t hash_values(const int *values, std::size_t points)
+    {
+        std::uint64_t hash = 0;
+        for (std::size_t i = 0; i < points; i++)
+        {
+            hash = (hash ^ (std::uint32_t)values[i]) * 0x100000001b3ull;
+        }
+        return mix64(hash);
+    }
+
+    bool contains(const int *values, std::uint64_t hash) const
+    {
+        if (table_.empty())
+        {
+            return false;
+        }
+        const std::size_t mask = table_.size() - 1;
+        for (std::size_t slot = hash & mask; table_[slot] != 0; slot = (slot + 1) & mask)
+        {
+            const std::uint32_t id = table_[slot] - 1;
+            if (hashes_[id] == (std::uint32_t)(hash >> 32) &&
+                std::memcmp(&values_[(std::size_t)id * points_], values, points_ * sizeof(int)) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Keeps the expression unless the bank knows its values or is full.
+    void insert(const Origin &origin, const int *values)
+    {
+        const std::uint64_t hash = hash_values(values, points_);
+        if (frozen_ || contains(values, hash))
+        {
+            return;
+        }
+        if (origins_.size() == max_entries_)
+        {
+            frozen_ = true;
+            return;
+        }
+        if (origins_.size() == origins_.capacity())
+        {
+            const std::size_t entries = std::min(std::max<std::size_t>(1024, 2 * origins_.capacity()), max_entries_);
+            origins_.reserve(entries);
+            hashes_.reserve(entries);
+            values_.reserve(entries * points_);
+        }
+        if (2 * (origins_.size() + 1) > table_.size())
+        {
+            grow_table();
+        }
+        const std::uint32_t id = (std::uint32_t)origins_.size();
+        origins_.push_back(origin);
+        hashes_.push_back((std::uint32_t)(hash >> 32));
+        values_.insert(values_.end(), values, values + points_);
+        place(id, hash);
+    }
+
+    void place(std::uint32_t id, std::uint64_t hash)
+    {
+        const std::size_t mask = table_.size() - 1;
+        std::size_t slot = hash & mask;
+        while (table_[slot] != 0)
+        {
+            slot = (slot + 1) & mask;
+        }
+        table_[slot] = id + 1;
+    }
+
+    void grow_table()
+    {
+        std::vector<std::uint32_t>().swap(table_);
+        std::size_t slots = 1024;
+        while (slots < 2 * origins_.capacity())
+        {
+            slots *= 2;
+        }
+        table_.assign(slots, 0);
+        for (std::uint32_t id = 0; id < origins_.size(); id++)
+        {
+            place(id, hash_values(&values_[(std::size_t)id * points_], points_));
+        }
+    }
+
+    // Every `left` expression with every `right` one; with `triangle` the
+    // ranges are the same and only pairs with right >= left are built.
+    bool run_segment(std::uint8_t op, Range left, Range right, bool triangle, ThreadPool &pool)
+    {
+        std::uint32_t row = left.first;
+        while (row < left.second)
+        {
+            // Rows up to round_candidates combinations.
+            std::uint32_t end = row;
+            std::size_t combinations = 0;
+            while (end < left.second && combinations < round_candidates)
+            {
+                combinations += right.second - (triangle ? right.first + (end - left.first) : right.first);
+                end++;
+            }
+            if (run_round(op, row, end, left, right, triangle, pool))
+            {
+                return true;
+            }
+            row = end;
+        }
+        return false;
+    }
+
+    bool run_round(std::uint8_t op, std::uint32_t row_begin, std::uint32_t row_end, Range left, Range right, bool triangle,
+        ThreadPool &pool)
+    {
+        const std::size_t rows = row_end - row_begin;
+        const std::size_t grain = std::max<std::size_t>(1, rows / (8 * pool.size()));
+        const std::size_t chunk_count = (rows + grain - 1) / grain;
+        if (chunks_.size() < chunk_count)
+        {
+            chunks_.resize(chunk_count);
+        }
+        std::atomic<std::size_t> first_match{ chunk_count };
+        const bool keep = !frozen_;
+
+        pool.parallel_for(rows, grain, [&](std::size_t worker, std::size_t begin, std::size_t end) {
+            const std::size_t index = begin / grain;
+            Chunk &chunk = chunks_[index];
+            chunk.matched = false;
+            chunk.candidates = 0;
+            chunk.fresh.clear();
+            int *out = scratch_[worker].data();
+            for (std::size_t r = begin; r < end && index < first_match.load(std::memory_order_relaxed); r++)
+            {
+                const std::uint32_t lhs = row_begin + (std::uint32_t)r;
+                const int *lhs_values = &values_[(std::size_t)lhs * points_];
+                for (std::uint32_t rhs = triangle ? right.first + (lhs - left.first) : right.first; rhs < right.second; rhs++)
+                {
+                    apply(op, lhs_values, &values_[(std::size_t)rhs * points_], out, points_);
+                    chunk.candidates++;
+                    const Origin origin{ op, lhs, rhs };
+                    if (std::memcmp(out, target_.data(), points_ * sizeof(int)) == 0)
+                    {
+                        chunk.matched = true;
+                        chunk.match = origin;
+                        std::size_t seen = first_match.load(std::memory_order_relaxed);
+                        while (index < seen && !first_match.compare_exchange_weak(seen, index, std::memory_order_relaxed))
+                        {
+                        }
+                        return;
+                    }
+                    if (keep && !contains(out, hash_values(out, points_)))
+                    {
+                        chunk.fresh.push_back(origin);
+                    }
+                }
+            }
+        });
+
+        std::vector<int> &values = scratch_[0];
+        for (std::size_t c = 0; c < chunk_count; c++)
+        {
+            Chunk &chunk = chunks_[c];
+            candidates_ += chunk.candidates;
+            for (const Origin &origin : chunk.fresh)
+            {
+                if (frozen_)
+                {
+                    break;
+                }
+                apply(origin.op, &values_[(std::size_t)origin.left * points_], &values_[(std::size_t)origin.right * points_],
+                    values.data(), points_);
+                insert(origin, values.data());
+            }
+            // Rows past the match, which other chunks may have gone on
+            // with, are left out.
+            if (chunk.matched)
+            {
+                match_ = chunk.match;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::vector<int>> leaves_;
+    std::vector<int> target_;
+    std::size_t points_;
+    std::size_t max_entries_;
+
+    // Bank entry id: its values at values_[id * points_], its origin and
+    // the high half of its hash. Expressions of `size` nodes are the ids
+    // in levels_[size].
+    std::vector<int> values_;
+    std::vector<Origin> origins_;
+    std::vector<std::uint32_t> hashes_;
+    // Open addressing, id + 1 per slot, never more than half full.
+    std::vector<std::uint32_t> table_;
+    std::vector<Range> levels_;
+    bool frozen_ = false;
+
+    std::vector<Chunk> chunks_;
+    std::vector<std::vector<int>> scratch_;
+    Origin match_{ leaf, 0, 0 };
+    std::uint64_t candidates_ = 0;
+};
+
+#endif  // ENUMERATOR_H
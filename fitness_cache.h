@@ -0,0 +1,127 @@
+#ifndef FITNESS_CACHE_H
+#define FITNESS_CACHE_H
+
+// Errors of the programs a search has already evaluated, keyed by the
+// structural hash of their tree. The elite and the clones that breeding
+// produces come back every generation unchanged and skip compilation
+// and evaluation.
+//
+// Each entry also keeps the output fingerprint of the program, the
+// semantic key: trees of different shape that compute the same sequence
+// have the same one. Entries not looked up for `max_idle` generations are
+// dropped, so the cache stays a few populations large.
+//
+// Keys are 64-bit hashes and are trusted without comparing the trees; with
+// a few thousand entries a collision is not a practical concern.
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+
+class FitnessCache
+{
+public:
+    struct Entry
+    {
+        std::uint64_t error;
+        std::uint64_t fingerprint;
+        unsigned last_seen;
+    };
+
+    struct Stats
+    {
+        std::uint64_t lookups = 0;
+        std::uint64_t hits = 0;
+        // Individuals ranked last because an earlier one in the population
+        // has the same tree...
+        std::uint64_t duplicates = 0;
+        // ... or a different tree computing the same sequence.
+        std::uint64_t semantic_duplicates = 0;
+
+        double hit_rate() const noexcept { return lookups != 0 ? (double)hits / lookups : 0.; }
+
+        Stats& operator+=(const Stats &other) noexcept
+        {
+            lookups += other.lookups;
+            hits += other.hits;
+            duplicates += other.duplicates;
+            semantic_duplicates += other.semantic_duplicates;
+            return *this;
+        }
+    };
+
+    explicit FitnessCache(unsigned max_idle = 8) : max_idle_(max_idle)
+    {
+        entries_.reserve(4096);
+    }
+
+    // Does not count as a lookup. Safe from several threads as long as
+    // nothing is inserted meanwhile.
+    bool contains(std::uint64_t key) const
+    {
+        return entries_.count(key) != 0;
+    }
+
+    // nullptr on a miss.
+    const Entry* find(std::uint64_t key)
+    {
+        stats_.lookups++;
+        auto it = entries_.find(key);
+        if (it == entries_.end())
+        {
+            return nullptr;
+        }
+        stats_.hits++;
+        it->second.last_seen = generation_;
+        return &it->second;
+    }
+
+    void insert(std::uint64_t key, std::uint64_t error, std::uint64_t fingerprint)
+    {
+        entries_[key] = Entry{ error, fingerprint, generation_ };
+    }
+
+    // Old entries are swept every `max_idle` generations, not on every
+    // call.
+    void next_generation()
+    {
+        if (++generation_ % max_idle_ != 0)
+        {
+            return;
+        }
+        for (auto it = entries_.begin(); it != entries_.end();)
+        {
+            if (generation_ - it->second.last_seen > max_idle_)
+            {
+                it = entries_.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    Stats& stats() noexcept { return stats_; }
+    std::size_t size() const noexcept { return entries_.size(); }
+
+    // What a checkpoint needs to rebuild the cache with restore(): entries
+    // and the generation they are aged against.
+    const std::unordered_map<std::uint64_t, Entry>& entries() const noexcept { return entries_; }
+    unsigned generation() const noexcept { return generation_; }
+
+    void restore(unsigned generation, std::unordered_map<std::uint64_t, Entry> entries)
+    {
+        generation_ = generation;
+        entries_ = std::move(entries);
+    }
+
+private:
+    std::unordered_map<std::uint64_t, Entry> entries_;
+    Stats stats_;
+    unsigned max_idle_;
+    unsigned generation_ = 0;
+};
+
+#endif  // FITNESS_CACHE_H
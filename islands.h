@@ -0,0 +1,202 @@
+#ifndef ISLANDS_H
+#define ISLANDS_H
+
+// Shared state of an island search: independent populations in separate
+// processes that pass their best individuals around a ring. Island i
+// sends to island i + 1 through a single-producer single-consumer queue;
+// everything lives in one POSIX shared memory block mapped before fork.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include "bytecode.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "shared memory queues need address-free atomics");
+
+// A program as one byte per instruction: the opcode in the low four bits
+// and, for constants and lags 0..14, the argument in the high four.
+// Larger or negative ones take an escape byte and four more bytes.
+struct WireTree
+{
+    static constexpr std::size_t capacity = 62;
+
+    std::uint8_t size = 0;
+    std::uint8_t bytes[capacity];
+
+    // False if the program does not fit.
+    bool pack(const Program &program)
+    {
+        std::size_t len = 0;
+        for (const Instr &instr : program.code())
+        {
+            const std::uint8_t op = (std::uint8_t)instr.op;
+            if (!has_arg(instr.op) || (instr.arg >= 0 && instr.arg < 15))
+            {
+                if (len + 1 > capacity)
+                {
+                    return false;
+                }
+                bytes[len++] = (std::uint8_t)(op | (has_arg(instr.op) ? instr.arg << 4 : 0));
+            }
+            else
+            {
+                if (len + 5 > capacity)
+                {
+                    return false;
+                }
+                bytes[len++] = (std::uint8_t)(op | (15 << 4));
+                std::memcpy(&bytes[len], &instr.arg, 4);
+                len += 4;
+            }
+        }
+        size = (std::uint8_t)len;
+        return true;
+    }
+
+    void unpack(Program &program) const
+    {
+        program.clear();
+        for (std::size_t i = 0; i < size; i++)
+        {
+            const OpCode op = (OpCode)(bytes[i] & 15);
+            int arg = bytes[i] >> 4;
+            if (has_arg(op) && arg == 15)
+            {
+                std::memcpy(&arg, &bytes[i + 1], 4);
+                i += 4;
+            }
+            program.emit(op, has_arg(op) ? arg : 0);
+        }
+    }
+
+private:
+    static bool has_arg(OpCode op) { return op == OpCode::Value || op == OpCode::Lag; }
+};
+
+class MigrationRing
+{
+public:
+    static constexpr std::uint32_t capacity = 16;
+
+    // Drops the tree if the consumer is that far behind.
+    bool push(const WireTree &tree)
+    {
+        const std::uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == capacity)
+        {
+            return false;
+        }
+        slots_[head % capacity] = tree;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(WireTree &tree)
+    {
+        const std::uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        tree = slots_[tail % capacity];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    alignas(64) std::atomic<std::uint32_t> head_{ 0 };
+    alignas(64) std::atomic<std::uint32_t> tail_{ 0 };
+    WireTree slots_[capacity];
+};
+
+struct IslandState
+{
+    static constexpr int no_winner = -1;
+
+    std::atomic<int> winner{ no_winner };
+    std::atomic<bool> winner_ready{ false };
+    WireTree winner_tree;
+
+    // The first island to get here reports `tree`; the others learn
+    // they have to stop.
+    bool claim_win(int island, const WireTree &tree)
+    {
+        int expected = no_winner;
+        if (!winner.compare_exchange_strong(expected, island))
+        {
+            return false;
+        }
+        winner_tree = tree;
+        winner_ready.store(true, std::memory_order_release);
+        return true;
+    }
+
+    bool stopped() const { return winner.load(std::memory_order_relaxed) != no_winner; }
+};
+
+// Owns the mapping: an IslandState followed by one ring per island. The
+// name is unlinked right away, the memory stays until every process that
+// inherited the mapping has exited.
+class IslandShm
+{
+public:
+    explicit IslandShm(std::size_t islands) : islands_(islands), bytes_(rings_offset + islands * sizeof(MigrationRing))
+    {
+        const std::string name = "/seqgen-islands-" + std::to_string(getpid());
+        const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0)
+        {
+            throw std::runtime_error("shm_open failed");
+        }
+        shm_unlink(name.c_str());
+        void *memory = MAP_FAILED;
+        if (ftruncate(fd, (off_t)bytes_) == 0)
+        {
+            memory = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (memory == MAP_FAILED)
+        {
+            throw std::runtime_error("mapping shared memory failed");
+        }
+        memory_ = static_cast<std::uint8_t*>(memory);
+        new (memory_) IslandState();
+        for (std::size_t i = 0; i < islands_; i++)
+        {
+            new (memory_ + rings_offset + i * sizeof(MigrationRing)) MigrationRing();
+        }
+    }
+
+    IslandShm(const IslandShm&) = delete;
+    IslandShm& operator=(const IslandShm&) = delete;
+
+    ~IslandShm() { munmap(memory_, bytes_); }
+
+    IslandState& state() { return *reinterpret_cast<IslandState*>(memory_); }
+
+    // Trees sent to `island`.
+    MigrationRing& inbox(std::size_t island)
+    {
+        return *reinterpret_cast<MigrationRing*>(memory_ + rings_offset + island * sizeof(MigrationRing));
+    }
+
+    MigrationRing& outbox(std::size_t island) { return inbox((island + 1) % islands_); }
+
+private:
+    static constexpr std::size_t rings_offset = (sizeof(IslandState) + alignof(MigrationRing) - 1) / alignof(MigrationRing) * alignof(MigrationRing);
+
+    std::size_t islands_;
+    std::size_t bytes_;
+    std::uint8_t *memory_ = nullptr;
+};
+
+#endif  // ISLANDS_H
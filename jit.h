@@ -0,0 +1,570 @@
+#ifndef JIT_H
+#define JIT_H
+
+// Native x86-64 code for hot programs.
+//
+// A compiled program is one function that runs the whole recurrence:
+// n, xp and xpp live in r8d, r9d and r10d, the expression is evaluated in
+// registers allocated in Sethi-Ullman order, and only the result of each
+// step is stored. Code goes into fixed-size slots of a shared-memory
+// arena that is mapped twice, writable and executable, so compiling a
+// function needs no system calls and no page is ever writable and
+// executable at once.
+//
+// Only programs that keep being evaluated are worth the compile time;
+// JitCache counts uses per program and compiles on the threshold-th one.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "bytecode.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define SEQGEN_JIT 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+class JitArena
+{
+public:
+    static constexpr std::size_t slot_size = 512;
+    static constexpr std::size_t region_size = 1 << 20;
+
+    JitArena() = default;
+    JitArena(const JitArena&) = delete;
+    JitArena& operator=(const JitArena&) = delete;
+
+    ~JitArena()
+    {
+#if defined(SEQGEN_JIT)
+        for (const Region &region : regions_)
+        {
+            munmap(region.rw, region_size);
+            munmap(region.rx, region_size);
+        }
+#endif
+    }
+
+    // Copies `code` into a free slot and returns its executable address,
+    // or nullptr if the code does not fit or no memory can be mapped.
+    const void* place(const std::vector<std::uint8_t> &code)
+    {
+        if (code.size() > slot_size || (free_.empty() && !grow()))
+        {
+            return nullptr;
+        }
+        const Slot slot = free_.back();
+        free_.pop_back();
+        std::memcpy(regions_[slot.region].rw + slot.offset, code.data(), code.size());
+        return regions_[slot.region].rx + slot.offset;
+    }
+
+    void release(const void *fn)
+    {
+        const std::uint8_t *p = static_cast<const std::uint8_t*>(fn);
+        for (std::size_t r = 0; r < regions_.size(); r++)
+        {
+            if (p >= regions_[r].rx && p < regions_[r].rx + region_size)
+            {
+                free_.push_back(Slot{ r, (std::size_t)(p - regions_[r].rx) });
+                return;
+            }
+        }
+    }
+
+private:
+    struct Region
+    {
+        std::uint8_t *rw;
+        std::uint8_t *rx;
+    };
+    struct Slot
+    {
+        std::size_t region;
+        std::size_t offset;
+    };
+
+    bool grow()
+    {
+#if defined(SEQGEN_JIT)
+        const int fd = memfd_create("seqgen-jit", 0);
+        if (fd < 0)
+        {
+            return false;
+        }
+        void *rw = MAP_FAILED;
+        void *rx = MAP_FAILED;
+        if (ftruncate(fd, region_size) == 0)
+        {
+            rw = mmap(nullptr, region_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            rx = mmap(nullptr, region_size, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (rw == MAP_FAILED || rx == MAP_FAILED)
+        {
+            if (rw != MAP_FAILED)
+            {
+                munmap(rw, region_size);
+            }
+            if (rx != MAP_FAILED)
+            {
+                munmap(rx, region_size);
+            }
+            return false;
+        }
+        regions_.push_back(Region{ static_cast<std::uint8_t*>(rw), static_cast<std::uint8_t*>(rx) });
+        for (std::size_t offset = region_size; offset > 0; offset -= slot_size)
+        {
+            free_.push_back(Slot{ regions_.size() - 1, offset - slot_size });
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    std::vector<Region> regions_;
+    std::vector<Slot> free_;
+};
+
+class JitFunction
+{
+public:
+    using Fn = void (*)(int *seq, int *end);
+
+    JitFunction(JitArena &arena, const void *code) : arena_(arena), fn_(reinterpret_cast<Fn>(const_cast<void*>(code))) {}
+    JitFunction(const JitFunction&) = delete;
+    JitFunction& operator=(const JitFunction&) = delete;
+    ~JitFunction() { arena_.release(reinterpret_cast<const void*>(fn_)); }
+
+    // Same contract as Program::run_sequence.
+    void run_sequence(int *seq, std::size_t count) const
+    {
+        if (count > 2)
+        {
+            fn_(seq, seq + count);
+        }
+    }
+
+private:
+    JitArena &arena_;
+    Fn fn_;
+};
+
+namespace jit_detail
+{
+
+// Register numbers as encoded in ModRM/REX.
+enum Reg : std::uint8_t
+{
+    eax = 0, ecx = 1, edx = 2, ebx = 3,
+    r8 = 8, r9 = 9, r10 = 10, r11 = 11, r12 = 12, r13 = 13, r14 = 14, r15 = 15
+};
+
+constexpr Reg temps[] = { eax, ecx, edx, r11, ebx, r12, r13, r14, r15 };
+constexpr std::size_t temp_count = sizeof(temps) / sizeof(temps[0]);
+constexpr std::size_t scratch_temps = 4;  // eax, ecx, edx, r11 need no saving
+
+inline Reg leaf_reg(OpCode op)
+{
+    return op == OpCode::N ? r8 : op == OpCode::XP ? r9 : r10;
+}
+
+class Emitter
+{
+public:
+    explicit Emitter(std::vector<std::uint8_t> &out) : out_(out) {}
+
+    void byte(std::uint8_t b) { out_.push_back(b); }
+
+    void imm32(std::int32_t v)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            byte((std::uint8_t)((std::uint32_t)v >> (8 * i)));
+        }
+    }
+
+    void rex(bool r, bool b)
+    {
+        if (r || b)
+        {
+            byte((std::uint8_t)(0x40 | (r << 2) | b));
+        }
+    }
+
+    // `op r/m32, r32` forms: mov 89, add 01, sub 29.
+    void rm_reg(std::uint8_t opcode, Reg dst, Reg src)
+    {
+        rex(src >= 8, dst >= 8);
+        byte(opcode);
+        byte((std::uint8_t)(0xC0 | ((src & 7) << 3) | (dst & 7)));
+    }
+
+    void mov(Reg dst, Reg src) { if (dst != src) rm_reg(0x89, dst, src); }
+    void add(Reg dst, Reg src) { rm_reg(0x01, dst, src); }
+    void sub(Reg dst, Reg src) { rm_reg(0x29, dst, src); }
+
+    void imul(Reg dst, Reg src)
+    {
+        rex(dst >= 8, src >= 8);
+        byte(0x0F);
+        byte(0xAF);
+        byte((std::uint8_t)(0xC0 | ((dst & 7) << 3) | (src & 7)));
+    }
+
+    void mov_imm(Reg dst, std::int32_t v)
+    {
+        rex(false, dst >= 8);
+        byte((std::uint8_t)(0xB8 | (dst & 7)));
+        imm32(v);
+    }
+
+    // add 81 /0, sub 81 /5
+    void arith_imm(std::uint8_t ext, Reg dst, std::int32_t v)
+    {
+        rex(false, dst >= 8);
+        byte(0x81);
+        byte((std::uint8_t)(0xC0 | (ext << 3) | (dst & 7)));
+        imm32(v);
+    }
+
+    void imul_imm(Reg dst, std::int32_t v)
+    {
+        rex(dst >= 8, dst >= 8);
+        byte(0x69);
+        byte((std::uint8_t)(0xC0 | ((dst & 7) << 3) | (dst & 7)));
+        imm32(v);
+    }
+
+    void neg(Reg dst)
+    {
+        rex(false, dst >= 8);
+        byte(0xF7);
+        byte((std::uint8_t)(0xC0 | (3 << 3) | (dst & 7)));
+    }
+
+    void push(Reg r) { rex(false, r >= 8); byte((std::uint8_t)(0x50 | (r & 7))); }
+    void pop(Reg r) { rex(false, r >= 8); byte((std::uint8_t)(0x58 | (r & 7))); }
+
+    std::size_t size() const { return out_.size(); }
+
+    void patch_rel32(std::size_t at, std::size_t target)
+    {
+        const std::int32_t rel = (std::int32_t)target - (std::int32_t)(at + 4);
+        std::memcpy(out_.data() + at, &rel, 4);
+    }
+
+private:
+    std::vector<std::uint8_t> &out_;
+};
+
+// Expression tree rebuilt from the postfix code, with the number of
+// registers every subtree needs.
+class Codegen
+{
+public:
+    Codegen(const Program &program, Emitter &e) : code_(program.code()), e_(e)
+    {
+        lhs_.resize(code_.size());
+        rhs_.resize(code_.size());
+        need_.resize(code_.size());
+        std::vector<std::size_t> stack;
+        for (std::size_t p = 0; p < code_.size(); p++)
+        {
+            if (code_[p].op >= OpCode::Plus)
+            {
+                rhs_[p] = stack.back();
+                stack.pop_back();
+                lhs_[p] = stack.back();
+                stack.pop_back();
+                const std::size_t l = need_[lhs_[p]];
+                const std::size_t r = is_leaf(rhs_[p]) ? 0 : need_[rhs_[p]];
+                need_[p] = l == r ? l + 1 : std::max(l, r);
+            }
+            else
+            {
+                need_[p] = 1;
+            }
+            stack.push_back(p);
+        }
+        root_ = code_.empty() ? 0 : stack.back();
+    }
+
+    std::size_t registers() const { return code_.empty() ? 0 : need_[root_]; }
+
+    void emit() { gen(root_, 0); }
+
+private:
+    bool is_leaf(std::size_t p) const { return code_[p].op < OpCode::Plus; }
+
+    void load_leaf(std::size_t p, Reg dst)
+    {
+        if (code_[p].op == OpCode::Value)
+        {
+            e_.mov_imm(dst, code_[p].arg);
+        }
+        else
+        {
+            e_.mov(dst, leaf_reg(code_[p].op));
+        }
+    }
+
+    // Leaves on the right are used in place, as an immediate or a register.
+    void apply_leaf(OpCode op, Reg dst, std::size_t leaf)
+    {
+        if (code_[leaf].op == OpCode::Value)
+        {
+            const std::int32_t v = code_[leaf].arg;
+            if (op == OpCode::Plus) e_.arith_imm(0, dst, v);
+            else if (op == OpCode::Minus) e_.arith_imm(5, dst, v);
+            else e_.imul_imm(dst, v);
+            return;
+        }
+        apply(op, dst, leaf_reg(code_[leaf].op));
+    }
+
+    void apply(OpCode op, Reg dst, Reg src)
+    {
+        if (op == OpCode::Plus) e_.add(dst, src);
+        else if (op == OpCode::Minus) e_.sub(dst, src);
+        else e_.imul(dst, src);
+    }
+
+    // Result in temps[d], using temps[d..] only.
+    void gen(std::size_t p, std::size_t d)
+    {
+        const Reg dst = temps[d];
+        if (is_leaf(p))
+        {
+            load_leaf(p, dst);
+            return;
+        }
+        const OpCode op = code_[p].op;
+        const std::size_t l = lhs_[p];
+        const std::size_t r = rhs_[p];
+        if (is_leaf(r))
+        {
+            gen(l, d);
+            apply_leaf(op, dst, r);
+        }
+        else if (need_[l] >= need_[r])
+        {
+            gen(l, d);
+            gen(r, d + 1);
+            apply(op, dst, temps[d + 1]);
+        }
+        else
+        {
+            gen(r, d);
+            gen(l, d + 1);
+            if (op == OpCode::Minus)
+            {
+                e_.neg(dst);
+                e_.add(dst, temps[d + 1]);
+            }
+            else
+            {
+                apply(op, dst, temps[d + 1]);
+            }
+        }
+    }
+
+    const std::vector<Instr> &code_;
+    Emitter &e_;
+    std::vector<std::size_t> lhs_;
+    std::vector<std::size_t> rhs_;
+    std::vector<std::size_t> need_;
+    std::size_t root_ = 0;
+};
+
+}  // namespace jit_detail
+
+inline bool jit_supported()
+{
+#if defined(SEQGEN_JIT)
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Machine code for `void fn(int *seq, int *end)`: fills seq[2..] like
+// Program::run_sequence. Returns false when the expression needs more
+// registers than there are, or reads lags or sums, which have none.
+inline bool jit_codegen(const Program &program, std::vector<std::uint8_t> &out)
+{
+    using namespace jit_detail;
+    out.clear();
+    if (program.lookback() > 2 || program.reads_sum())
+    {
+        return false;
+    }
+    Emitter e(out);
+    Codegen gen(program, e);
+    const std::size_t regs = gen.registers();
+    if (regs == 0 || regs > temp_count)
+    {
+        return false;
+    }
+
+    for (std::size_t t = scratch_temps; t < regs; t++)
+    {
+        e.push(temps[t]);
+    }
+    const std::uint8_t prologue[] = {
+        0x44, 0x8B, 0x17,                   // mov r10d, [rdi]
+        0x44, 0x8B, 0x4F, 0x04,             // mov r9d, [rdi + 4]
+        0x41, 0xB8, 0x03, 0x00, 0x00, 0x00, // mov r8d, 3
+        0x48, 0x83, 0xC7, 0x08,             // add rdi, 8
+        0x48, 0x39, 0xF7,                   // cmp rdi, rsi
+        0x0F, 0x83,                         // jae done
+    };
+    for (std::uint8_t b : prologue) e.byte(b);
+    const std::size_t to_done = e.size();
+    e.imm32(0);
+
+    const std::size_t loop = e.size();
+    gen.emit();
+    const std::uint8_t step[] = {
+        0x89, 0x07,                         // mov [rdi], eax
+        0x45, 0x89, 0xCA,                   // mov r10d, r9d
+        0x41, 0x89, 0xC1,                   // mov r9d, eax
+        0x41, 0xFF, 0xC0,                   // inc r8d
+        0x48, 0x83, 0xC7, 0x04,             // add rdi, 4
+        0x48, 0x39, 0xF7,                   // cmp rdi, rsi
+        0x0F, 0x82,                         // jb loop
+    };
+    for (std::uint8_t b : step) e.byte(b);
+    const std::size_t to_loop = e.size();
+    e.imm32(0);
+    e.patch_rel32(to_loop, loop);
+    e.patch_rel32(to_done, e.size());
+
+    for (std::size_t t = regs; t-- > scratch_temps;)
+    {
+        e.pop(temps[t]);
+    }
+    e.byte(0xC3);  // ret
+    return true;
+}
+
+inline std::unique_ptr<JitFunction> jit_compile(JitArena &arena, const Program &program)
+{
+    std::vector<std::uint8_t> code;
+    if (!jit_supported() || !jit_codegen(program, code))
+    {
+        return nullptr;
+    }
+    const void *fn = arena.place(code);
+    return fn != nullptr ? std::unique_ptr<JitFunction>(new JitFunction(arena, fn)) : nullptr;
+}
+
+// Compiled functions keyed by program text. Entries that were not looked
+// up for `max_idle` generations are dropped.
+class JitCache
+{
+public:
+    explicit JitCache(unsigned threshold, unsigned max_idle = 2) : threshold_(threshold), max_idle_(max_idle)
+    {
+        entries_.reserve(1024);
+    }
+
+    // Counts a use of `program`; returns its compiled form once it has
+    // been used `threshold` times, nullptr before that or if it cannot be
+    // compiled.
+    const JitFunction* lookup(const Program &program) { return lookup(program, program.hash()); }
+
+    // Same, with program.hash() already at hand.
+    const JitFunction* lookup(const Program &program, std::uint64_t key)
+    {
+        if (threshold_ == 0)
+        {
+            return nullptr;
+        }
+        Entry &entry = entries_[key];
+        entry.last_seen = generation_;
+        if (entry.fn)
+        {
+            return same_code(entry.code, program.code()) ? entry.fn.get() : nullptr;
+        }
+        // Uses counted by touch() may have taken it to the threshold
+        // already; it is compiled at its first evaluation after that.
+        if (!entry.tried && ++entry.uses >= threshold_)
+        {
+            entry.tried = true;
+            entry.fn = jit_compile(arena_, program);
+            entry.code = program.code();
+            compiled_ += entry.fn != nullptr;
+        }
+        return entry.fn.get();
+    }
+
+    // Counts a use of the program with hash `key` that needs no
+    // evaluation, such as one whose score was cached.
+    void touch(std::uint64_t key)
+    {
+        if (threshold_ == 0)
+        {
+            return;
+        }
+        Entry &entry = entries_[key];
+        entry.last_seen = generation_;
+        if (!entry.tried)
+        {
+            entry.uses++;
+        }
+    }
+
+    void next_generation()
+    {
+        generation_++;
+        for (auto it = entries_.begin(); it != entries_.end();)
+        {
+            if (generation_ - it->second.last_seen > max_idle_)
+            {
+                it = entries_.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    std::size_t compiled() const noexcept { return compiled_; }
+    std::size_t size() const noexcept { return entries_.size(); }
+
+private:
+    struct Entry
+    {
+        std::vector<Instr> code;
+        unsigned uses = 0;
+        unsigned last_seen = 0;
+        bool tried = false;
+        std::unique_ptr<JitFunction> fn;
+    };
+
+
+    static bool same_code(const std::vector<Instr> &lhs, const std::vector<Instr> &rhs)
+    {
+        return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](const Instr &l, const Instr &r) {
+            return l.op == r.op && l.arg == r.arg;
+        });
+    }
+
+    JitArena arena_;
+    std::unordered_map<std::uint64_t, Entry> entries_;
+    unsigned threshold_;
+    unsigned max_idle_;
+    unsigned generation_ = 0;
+    std::size_t compiled_ = 0;
+};
+
+#endif  // JIT_H
@@ -0,0 +1,67 @@
+#ifndef JOB_QUEUE_H
+#define JOB_QUEUE_H
+
+// Fixed-capacity queue between one producer and any number of consumers.
+// push() waits while the queue is full, so a producer reading an input of
+// any length keeps at most `capacity` items in memory; pop() waits while
+// it is empty and returns false once it is closed and drained.
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+template <class T>
+class JobQueue
+{
+public:
+    explicit JobQueue(std::size_t capacity) : capacity_(capacity != 0 ? capacity : 1) {}
+
+    JobQueue(const JobQueue&) = delete;
+    JobQueue& operator=(const JobQueue&) = delete;
+
+    void push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this] { return items_.size() < capacity_; });
+        items_.push_back(std::move(item));
+        lock.unlock();
+        not_empty_.notify_one();
+    }
+
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+        if (items_.empty())
+        {
+            return false;
+        }
+        item = std::move(items_.front());
+        items_.pop_front();
+        lock.unlock();
+        not_full_.notify_one();
+        return true;
+    }
+
+    // No more pushes; consumers finish what is queued and then stop.
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        not_empty_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::deque<T> items_;
+    std::size_t capacity_;
+    bool closed_ = false;
+};
+
+#endif  // JOB_QUEUE_H
@@ -0,0 +1,331 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+// Memory for tree nodes.
+//
+// Nodes live in 16 KB pages cut from 1 MB slabs, the only memory ever
+// requested from the system. Every page holds blocks of one size class
+// for one arena and starts with a header naming both, so freeing a node
+// needs neither its size nor its arena.
+//
+// An arena is the node memory of one owner, a NodeStore: its pages are
+// its own until it goes. Each thread keeps free lists for the arena it
+// last allocated from and trades blocks with the arena's shared lists in
+// batches, without a lock. The pool's lock is taken once per page, and
+// when a thread moves on to another arena.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+class NodeArena;
+
+namespace node_pool_detail
+{
+
+constexpr std::size_t page_size = 16 << 10;
+constexpr std::size_t slab_pages = 64;
+constexpr std::size_t header_size = 16;
+constexpr std::size_t granularity = 16;
+constexpr std::size_t size_classes = 4;
+constexpr std::size_t batch = 64;
+
+struct PageHeader
+{
+    std::uint8_t size_class;
+    NodeArena *arena;
+};
+
+static_assert(sizeof(PageHeader) <= header_size, "page header too large");
+
+inline PageHeader* page_of(const void *p)
+{
+    return reinterpret_cast<PageHeader*>(reinterpret_cast<std::uintptr_t>(p) & ~(std::uintptr_t)(page_size - 1));
+}
+
+struct FreeBlock
+{
+    FreeBlock *next;
+};
+
+}  // namespace node_pool_detail
+
+// Has to outlive every block allocated from it: its pages go back to the
+// pool with it.
+class NodeArena
+{
+public:
+    explicit NodeArena(void *owner);
+    ~NodeArena();
+
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    void* owner() const noexcept { return owner_; }
+
+    static NodeArena& of(const void *p) { return *node_pool_detail::page_of(p)->arena; }
+
+private:
+    friend class NodePool;
+
+    void *owner_;
+    // Tells an arena from an earlier one at the same address.
+    std::uint64_t id_;
+    // Blocks spilled by threads, taken back a whole list at a time.
+    std::atomic<node_pool_detail::FreeBlock*> shared_[node_pool_detail::size_classes] = {};
+    // Under the pool's lock.
+    std::vector<char*> pages_;
+};
+
+class NodePool
+{
+public:
+    static constexpr std::size_t max_block = node_pool_detail::granularity * node_pool_detail::size_classes;
+
+    struct Stats
+    {
+        // Slabs requested from the system; flat in the steady state.
+        std::uint64_t system_allocations;
+        // Pages some arena holds.
+        std::uint64_t pages;
+    };
+
+    // Never destroyed, so thread caches can flush into it at any time.
+    static NodePool& instance()
+    {
+        static NodePool *pool = new NodePool();
+        return *pool;
+    }
+
+    void* allocate(NodeArena &arena, std::size_t bytes)
+    {
+        using namespace node_pool_detail;
+        ThreadCache &cache = local();
+        if (cache.arena != &arena || cache.arena_id != arena.id_)
+        {
+            bind(cache, arena);
+        }
+        const std::size_t cls = (bytes + granularity - 1) / granularity - 1;
+        if (cache.lists[cls] == nullptr)
+        {
+            refill(cache, cls);
+        }
+        FreeBlock *block = cache.lists[cls];
+        cache.lists[cls] = block->next;
+        cache.counts[cls]--;
+        return block;
+    }
+
+    // Any node pointer, whichever thread or arena it came from.
+    void deallocate(void *p)
+    {
+        using namespace node_pool_detail;
+        ThreadCache &cache = local();
+        const PageHeader *page = page_of(p);
+        const std::size_t cls = page->size_class;
+        FreeBlock *block = static_cast<FreeBlock*>(p);
+        if (page->arena != cache.arena || page->arena->id_ != cache.arena_id)
+        {
+            block->next = nullptr;
+            push(*page->arena, cls, block, block);
+            return;
+        }
+        block->next = cache.lists[cls];
+        cache.lists[cls] = block;
+        if (++cache.counts[cls] > 2 * batch)
+        {
+            spill(cache, cls, batch);
+        }
+    }
+
+    Stats stats()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return Stats{ system_allocations_, pages_ };
+    }
+
+private:
+    friend class NodeArena;
+
+    struct ThreadCache
+    {
+        NodeArena *arena = nullptr;
+        std::uint64_t arena_id = 0;
+        node_pool_detail::FreeBlock *lists[node_pool_detail::size_classes] = {};
+        std::size_t counts[node_pool_detail::size_classes] = {};
+
+        ~ThreadCache() { NodePool::instance().flush(*this); }
+    };
+
+    NodePool() = default;
+
+    static ThreadCache& local()
+    {
+        thread_local ThreadCache cache;
+        return cache;
+    }
+
+    void attach(NodeArena &arena)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        arena.id_ = ++arenas_created_;
+        arenas_.push_back(&arena);
+    }
+
+    // Takes back the pages of `arena`; blocks of it still in a thread
+    // cache are dropped when that thread moves on.
+    void detach(NodeArena &arena)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (std::size_t i = 0; i < arenas_.size(); i++)
+        {
+            if (arenas_[i] == &arena)
+            {
+                arenas_[i] = arenas_.back();
+                arenas_.pop_back();
+                break;
+            }
+        }
+        free_pages_.insert(free_pages_.end(), arena.pages_.begin(), arena.pages_.end());
+        pages_ -= arena.pages_.size();
+    }
+
+    void bind(ThreadCache &cache, NodeArena &arena)
+    {
+        flush(cache);
+        cache.arena = &arena;
+        cache.arena_id = arena.id_;
+    }
+
+    // Gives the blocks of a cache back to its arena, if it is still there.
+    void flush(ThreadCache &cache)
+    {
+        using namespace node_pool_detail;
+        std::lock_guard<std::mutex> lock(mutex_);
+        bool alive = false;
+        for (const NodeArena *arena : arenas_)
+        {
+            alive = alive || (arena == cache.arena && arena->id_ == cache.arena_id);
+        }
+        for (std::size_t cls = 0; cls < size_classes; cls++)
+        {
+            if (alive && cache.lists[cls] != nullptr)
+            {
+                FreeBlock *last = cache.lists[cls];
+                while (last->next != nullptr)
+                {
+                    last = last->next;
+                }
+                push(*cache.arena, cls, cache.lists[cls], last);
+            }
+            cache.lists[cls] = nullptr;
+            cache.counts[cls] = 0;
+        }
+        cache.arena = nullptr;
+        cache.arena_id = 0;
+    }
+
+    // Puts the chain `first`..`last` on a shared list of `arena`.
+    static void push(NodeArena &arena, std::size_t cls, node_pool_detail::FreeBlock *first, node_pool_detail::FreeBlock *last)
+    {
+        std::atomic<node_pool_detail::FreeBlock*> &list = arena.shared_[cls];
+        last->next = list.load(std::memory_order_relaxed);
+        while (!list.compare_exchange_weak(last->next, first, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    // Takes the whole shared list of the arena, or a fresh page if it is
+    // empty. Taking every block at once leaves nothing to race over.
+    void refill(ThreadCache &cache, std::size_t cls)
+    {
+        using namespace node_pool_detail;
+        FreeBlock *chain = cache.arena->shared_[cls].exchange(nullptr, std::memory_order_acquire);
+        if (chain == nullptr)
+        {
+            chain = take_page(*cache.arena, (std::uint8_t)cls);
+        }
+        cache.lists[cls] = chain;
+        for (; chain != nullptr; chain = chain->next)
+        {
+            cache.counts[cls]++;
+        }
+    }
+
+    void spill(ThreadCache &cache, std::size_t cls, std::size_t count)
+    {
+        using namespace node_pool_detail;
+        FreeBlock *first = cache.lists[cls];
+        FreeBlock *last = first;
+        for (std::size_t i = 1; i < count; i++)
+        {
+            last = last->next;
+        }
+        cache.lists[cls] = last->next;
+        cache.counts[cls] -= count;
+        push(*cache.arena, cls, first, last);
+    }
+
+    // The chain of all blocks of a new page of `arena`.
+    node_pool_detail::FreeBlock* take_page(NodeArena &arena, std::uint8_t size_class)
+    {
+        using namespace node_pool_detail;
+        char *page;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (free_pages_.empty())
+            {
+                char *slab = static_cast<char*>(::aligned_alloc(page_size, page_size * slab_pages));
+                if (slab == nullptr)
+                {
+                    throw std::bad_alloc();
+                }
+                system_allocations_++;
+                for (std::size_t i = slab_pages; i-- > 0;)
+                {
+                    free_pages_.push_back(slab + i * page_size);
+                }
+            }
+            page = free_pages_.back();
+            free_pages_.pop_back();
+            arena.pages_.push_back(page);
+            pages_++;
+        }
+        PageHeader *header = reinterpret_cast<PageHeader*>(page);
+        header->size_class = size_class;
+        header->arena = &arena;
+        const std::size_t block_size = (size_class + 1) * granularity;
+        FreeBlock *chain = nullptr;
+        for (std::size_t i = (page_size - header_size) / block_size; i-- > 0;)
+        {
+            FreeBlock *block = reinterpret_cast<FreeBlock*>(page + header_size + i * block_size);
+            block->next = chain;
+            chain = block;
+        }
+        return chain;
+    }
+
+    std::mutex mutex_;
+    std::vector<char*> free_pages_;
+    std::vector<NodeArena*> arenas_;
+    std::uint64_t arenas_created_ = 0;
+    std::uint64_t system_allocations_ = 0;
+    std::uint64_t pages_ = 0;
+};
+
+inline NodeArena::NodeArena(void *owner)
+    : owner_(owner)
+{
+    NodePool::instance().attach(*this);
+}
+
+inline NodeArena::~NodeArena()
+{
+    NodePool::instance().detach(*this);
+}
+
+#endif  // NODE_POOL_H
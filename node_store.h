@@ -0,0 +1,297 @@
+#ifndef NODE_STORE_H
+#define NODE_STORE_H
+
+// Hash-consed, reference-counted nodes.
+//
+// Nodes are made through NodeStore::make, which hands out the live node
+// equal to the one asked for if there is one, so identical subtrees are a
+// single object shared by every tree that contains them. A node never
+// changes once made: editing a tree means rebuilding the path from its root
+// to the edited point, and everything off that path is shared with the
+// original.
+//
+// NodeRef counts references; the last one to go takes the node out of the
+// store and frees it. The table is split into shards with a lock each and
+// may be used from any thread.
+//
+// Each store has its own table and its own NodeArena, so searches in
+// separate stores share no node and no lock but the pool's, taken once per
+// page. NodeStore::instance() is the one of the process; a store of one's
+// own has to outlive every node made in it.
+//
+// A node class T derives from StoredNode and provides
+//   static constexpr std::uint8_t tag;     distinct per class
+//   static std::uint64_t hash_of(args...); equal to hash() of T(args...)
+//   bool equals(args...) const;            true if T(args...) would equal it
+// with children compared by address, which is enough once they are
+// hash-consed themselves.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "node_pool.h"
+
+class StoredNode
+{
+public:
+    StoredNode() = default;
+    StoredNode(const StoredNode&) = delete;
+    StoredNode& operator=(const StoredNode&) = delete;
+
+    virtual std::uint64_t hash() const = 0;
+
+protected:
+    virtual ~StoredNode() = default;
+
+private:
+    friend class NodeStore;
+
+    // Chain of the table bucket the node is in.
+    StoredNode *next_ = nullptr;
+    mutable std::atomic<std::uint32_t> refs_{ 0 };
+    std::uint8_t tag_ = 0;
+};
+
+template <class T>
+class NodeRef;
+
+class NodeStore
+{
+public:
+    struct Stats
+    {
+        std::uint64_t lookups;
+        // Lookups answered with a node that was already alive.
+        std::uint64_t shared;
+        std::uint64_t nodes;
+    };
+
+    NodeStore() : arena_(this) {}
+    NodeStore(const NodeStore&) = delete;
+    NodeStore& operator=(const NodeStore&) = delete;
+
+    // Never destroyed, so references may outlive everything else.
+    static NodeStore& instance()
+    {
+        static NodeStore *store = new NodeStore();
+        return *store;
+    }
+
+    // The store `node` was made in.
+    static NodeStore& of(const StoredNode *node)
+    {
+        return *static_cast<NodeStore*>(NodeArena::of(node).owner());
+    }
+
+    template <class T, class... Args>
+    NodeRef<const T> make(Args&&... args);
+
+    static void retain(const StoredNode *node)
+    {
+        node->refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void release(const StoredNode *node)
+    {
+        if (node->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            of(node).retire(node);
+        }
+    }
+
+    Stats stats()
+    {
+        Stats stats{ 0, 0, 0 };
+        for (Shard &shard : shards_)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            stats.lookups += shard.lookups;
+            stats.shared += shard.shared;
+            stats.nodes += shard.nodes;
+        }
+        return stats;
+    }
+
+private:
+    static constexpr std::size_t shard_bits = 6;
+    static constexpr std::size_t initial_buckets = 64;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::vector<StoredNode*> buckets = std::vector<StoredNode*>(initial_buckets);
+        std::uint64_t nodes = 0;
+        std::uint64_t lookups = 0;
+        std::uint64_t shared = 0;
+    };
+
+    // High bits pick the shard, low bits the bucket.
+    Shard& shard_of(std::uint64_t hash) { return shards_[hash >> (64 - shard_bits)]; }
+
+    static StoredNode*& bucket_of(Shard &shard, std::uint64_t hash)
+    {
+        return shard.buckets[hash & (shard.buckets.size() - 1)];
+    }
+
+    // A node whose count already dropped to zero is being retired and must
+    // not come back.
+    static bool try_retain(const StoredNode *node)
+    {
+        std::uint32_t refs = node->refs_.load(std::memory_order_relaxed);
+        while (refs != 0)
+        {
+            if (node->refs_.compare_exchange_weak(refs, refs + 1, std::memory_order_relaxed))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void insert(Shard &shard, StoredNode *node)
+    {
+        if (++shard.nodes > shard.buckets.size())
+        {
+            std::vector<StoredNode*> old(shard.buckets.size() * 2);
+            old.swap(shard.buckets);
+            for (StoredNode *chain : old)
+            {
+                while (chain != nullptr)
+                {
+                    StoredNode *next = chain->next_;
+                    StoredNode *&bucket = bucket_of(shard, chain->hash());
+                    chain->next_ = bucket;
+                    bucket = chain;
+                    chain = next;
+                }
+            }
+        }
+        StoredNode *&bucket = bucket_of(shard, node->hash());
+        node->next_ = bucket;
+        bucket = node;
+    }
+
+    // Unlinked under the lock, destroyed outside it: the destructor
+    // releases the children, which may retire them in turn.
+    void retire(const StoredNode *node)
+    {
+        const std::uint64_t hash = node->hash();
+        Shard &shard = shard_of(hash);
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (StoredNode **link = &bucket_of(shard, hash); *link != nullptr; link = &(*link)->next_)
+            {
+                if (*link == node)
+                {
+                    *link = node->next_;
+                    shard.nodes--;
+                    break;
+                }
+            }
+        }
+        StoredNode *block = const_cast<StoredNode*>(node);
+        block->~StoredNode();
+        NodePool::instance().deallocate(block);
+    }
+
+    Shard shards_[1 << shard_bits];
+    NodeArena arena_;
+};
+
+// Intrusive counted reference to a stored node, the node equivalent of
+// std::shared_ptr.
+template <class T>
+class NodeRef
+{
+public:
+    NodeRef() = default;
+    NodeRef(std::nullptr_t) {}
+
+    // Another reference to a node some NodeRef already holds.
+    explicit NodeRef(T *node) : node_(node)
+    {
+        if (node_ != nullptr)
+        {
+            NodeStore::retain(node_);
+        }
+    }
+
+    NodeRef(const NodeRef &other) : NodeRef(other.node_) {}
+    NodeRef(NodeRef &&other) noexcept : node_(other.node_) { other.node_ = nullptr; }
+
+    template <class U>
+    NodeRef(const NodeRef<U> &other) : NodeRef(other.node_) {}
+
+    template <class U>
+    NodeRef(NodeRef<U> &&other) noexcept : node_(other.node_) { other.node_ = nullptr; }
+
+    ~NodeRef() { reset(); }
+
+    NodeRef& operator=(NodeRef other) noexcept
+    {
+        std::swap(node_, other.node_);
+        return *this;
+    }
+
+    void reset()
+    {
+        if (node_ != nullptr)
+        {
+            NodeStore::release(node_);
+            node_ = nullptr;
+        }
+    }
+
+    T* get() const noexcept { return node_; }
+    T* operator->() const noexcept { return node_; }
+    T& operator*() const noexcept { return *node_; }
+    explicit operator bool() const noexcept { return node_ != nullptr; }
+
+    friend bool operator==(const NodeRef &lhs, const NodeRef &rhs) noexcept { return lhs.node_ == rhs.node_; }
+    friend bool operator!=(const NodeRef &lhs, const NodeRef &rhs) noexcept { return lhs.node_ != rhs.node_; }
+
+private:
+    template <class U>
+    friend class NodeRef;
+    friend class NodeStore;
+
+    // Takes over a count the caller already holds.
+    static NodeRef adopt(T *node)
+    {
+        NodeRef ref;
+        ref.node_ = node;
+        return ref;
+    }
+
+    T *node_ = nullptr;
+};
+
+template <class T, class... Args>
+NodeRef<const T> NodeStore::make(Args&&... args)
+{
+    const std::uint64_t hash = T::hash_of(args...);
+    Shard &shard = shard_of(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.lookups++;
+    for (StoredNode *node = bucket_of(shard, hash); node != nullptr; node = node->next_)
+    {
+        if (node->tag_ == T::tag && static_cast<const T*>(node)->equals(args...) && try_retain(node))
+        {
+            shard.shared++;
+            return NodeRef<const T>::adopt(static_cast<const T*>(node));
+        }
+    }
+    static_assert(sizeof(T) <= NodePool::max_block, "node class too large for the node pool");
+    T *node = new (NodePool::instance().allocate(arena_, sizeof(T))) T(std::forward<Args>(args)...);
+    node->tag_ = T::tag;
+    node->refs_.store(1, std::memory_order_relaxed);
+    insert(shard, node);
+    return NodeRef<const T>::adopt(node);
+}
+
+#endif  // NODE_STORE_H
@@ -0,0 +1,251 @@
+#ifndef RNG_H
+#define RNG_H
+
+// Random numbers for the search: xoshiro256** per thread, bounded integers
+// without modulo bias, and alias tables for weighted choices.
+//
+// Everything derives from one global seed. Code that hands work to other
+// threads reseeds the thread's generator per work item with
+// seed_thread_rng, so a run is reproducible no matter which thread picks
+// up which item.
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// splitmix64 finaliser: a bijection that scatters nearby inputs.
+inline std::uint64_t mix64(std::uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+class Xoshiro256
+{
+public:
+    explicit Xoshiro256(std::uint64_t seed = 0) { this->seed(seed); }
+
+    void seed(std::uint64_t seed)
+    {
+        for (std::uint64_t &word : s_)
+        {
+            seed += 0x9e3779b97f4a7c15ull;
+            word = mix64(seed);
+        }
+    }
+
+    std::uint64_t next()
+    {
+        const std::uint64_t result = rotl(s_[1] * 5, 7) * 9;
+        const std::uint64_t t = s_[1] << 17;
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = rotl(s_[3], 45);
+        return result;
+    }
+
+    std::uint32_t next32() { return (std::uint32_t)(next() >> 32); }
+
+    // Uniform in [0, range), range > 0. Lemire's multiply-shift with
+    // rejection of the few values that would bias the result.
+    std::uint32_t bounded(std::uint32_t range)
+    {
+        std::uint64_t m = (std::uint64_t)next32() * range;
+        std::uint32_t low = (std::uint32_t)m;
+        if (low < range)
+        {
+            const std::uint32_t threshold = (0u - range) % range;
+            while (low < threshold)
+            {
+                m = (std::uint64_t)next32() * range;
+                low = (std::uint32_t)m;
+            }
+        }
+        return (std::uint32_t)(m >> 32);
+    }
+
+    // Uniform in [min, max].
+    int uniform(int min, int max)
+    {
+        return (int)((unsigned)min + bounded((std::uint32_t)((unsigned)max - (unsigned)min) + 1));
+    }
+
+private:
+    static std::uint64_t rotl(std::uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+    std::uint64_t s_[4];
+};
+
+namespace rng_detail
+{
+
+inline std::atomic<std::uint64_t>& seed_storage()
+{
+    static std::atomic<std::uint64_t> seed{ ((std::uint64_t)std::random_device{}() << 32) | std::random_device{}() };
+    return seed;
+}
+
+inline std::atomic<std::uint64_t>& counter(int which)
+{
+    static std::atomic<std::uint64_t> counters[2];
+    return counters[which];
+}
+
+}  // namespace rng_detail
+
+inline std::uint64_t global_seed()
+{
+    return rng_detail::seed_storage().load(std::memory_order_relaxed);
+}
+
+inline Xoshiro256& thread_rng()
+{
+    thread_local Xoshiro256 rng(mix64(global_seed() ^ mix64(rng_detail::counter(0)++)));
+    return rng;
+}
+
+// Takes effect for threads that have not drawn a number yet and for the
+// calling thread; call it before starting any work.
+inline void set_global_seed(std::uint64_t seed)
+{
+    rng_detail::seed_storage().store(seed, std::memory_order_relaxed);
+    rng_detail::counter(0) = 0;
+    rng_detail::counter(1) = 0;
+    thread_rng().seed(mix64(seed ^ mix64(rng_detail::counter(0)++)));
+}
+
+// A fresh seed for each search started in this process, derived from the
+// global seed in the order the searches start.
+inline std::uint64_t next_search_seed()
+{
+    return mix64(global_seed() + mix64(++rng_detail::counter(1)));
+}
+
+// Points this thread's generator at stream `item` of `seed`.
+inline void seed_thread_rng(std::uint64_t seed, std::uint64_t item)
+{
+    thread_rng().seed(mix64(seed ^ mix64(item)));
+}
+
+namespace rng_detail
+{
+
+// Vose's construction over n weights whose sum fits 32 bits and is not
+// zero. Column i is outcome i with probability threshold[i] / total and
+// alias[i] otherwise. Scaled weights are w * n against total; the other
+// arguments are scratch of n entries.
+template <class Weights, class Table, class Scaled, class Stack>
+std::uint32_t build_alias(const Weights &weights, std::size_t n, Table &threshold, Table &alias,
+                          Scaled &scaled, Stack &small, Stack &large)
+{
+    std::uint64_t total = 0;
+    for (std::size_t i = 0; i < n; i++)
+    {
+        total += weights[i];
+    }
+
+    std::size_t n_small = 0, n_large = 0;
+    for (std::size_t i = 0; i < n; i++)
+    {
+        scaled[i] = (std::uint64_t)weights[i] * n;
+        alias[i] = (std::uint32_t)i;
+        if (scaled[i] < total)
+        {
+            small[n_small++] = i;
+        }
+        else
+        {
+            large[n_large++] = i;
+        }
+    }
+    while (n_small > 0 && n_large > 0)
+    {
+        const std::size_t s = small[--n_small];
+        const std::size_t l = large[n_large - 1];
+        threshold[s] = (std::uint32_t)scaled[s];
+        alias[s] = (std::uint32_t)l;
+        scaled[l] -= total - scaled[s];
+        if (scaled[l] < total)
+        {
+            n_large--;
+            small[n_small++] = l;
+        }
+    }
+    while (n_large > 0)
+    {
+        threshold[large[--n_large]] = (std::uint32_t)total;
+    }
+    while (n_small > 0)
+    {
+        threshold[small[--n_small]] = (std::uint32_t)total;
+    }
+    return (std::uint32_t)total;
+}
+
+}  // namespace rng_detail
+
+// Vose's alias method on integer weights: two draws per sample whatever
+// the number of outcomes, and exact probabilities w[i] / sum(w).
+template <std::size_t N>
+class AliasTable
+{
+public:
+    explicit AliasTable(const std::array<std::uint32_t, N> &weights)
+    {
+        std::array<std::uint64_t, N> scaled;
+        std::array<std::size_t, N> small, large;
+        total_ = rng_detail::build_alias(weights, N, threshold_, alias_, scaled, small, large);
+    }
+
+    std::size_t sample(Xoshiro256 &rng = thread_rng()) const
+    {
+        const std::uint32_t column = rng.bounded((std::uint32_t)N);
+        return rng.bounded(total_) < threshold_[column] ? column : alias_[column];
+    }
+
+private:
+    std::uint32_t total_;
+    std::array<std::uint32_t, N> threshold_;
+    std::array<std::uint32_t, N> alias_;
+};
+
+// The same with the number of outcomes chosen at run time. Rebuilding
+// reuses the storage of the previous table.
+class DynamicAliasTable
+{
+public:
+    void assign(const std::vector<std::uint32_t> &weights)
+    {
+        const std::size_t n = weights.size();
+        threshold_.resize(n);
+        alias_.resize(n);
+        scaled_.resize(n);
+        small_.resize(n);
+        large_.resize(n);
+        total_ = rng_detail::build_alias(weights, n, threshold_, alias_, scaled_, small_, large_);
+    }
+
+    std::size_t size() const noexcept { return alias_.size(); }
+
+    std::size_t sample(Xoshiro256 &rng = thread_rng()) const
+    {
+        const std::uint32_t column = rng.bounded((std::uint32_t)alias_.size());
+        return rng.bounded(total_) < threshold_[column] ? column : alias_[column];
+    }
+
+private:
+    std::uint32_t total_ = 0;
+    std::vector<std::uint32_t> threshold_;
+    std::vector<std::uint32_t> alias_;
+    std::vector<std::uint64_t> scaled_;
+    std::vector<std::size_t> small_, large_;
+};
+
+#endif  // RNG_H
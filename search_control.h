@@ -0,0 +1,145 @@
+#ifndef SEARCH_CONTROL_H
+#define SEARCH_CONTROL_H
+
+// Bounds on a running search and its best result so far, shared between
+// the search thread and whoever started it. A search checks its bounds
+// once a generation: a relaxed load for the cancel flag and one clock
+// read for the deadline, next to a generation's tens of microseconds.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+// Why a search ended.
+enum class SearchStop
+{
+    solved,
+    generations,
+    evaluations,
+    deadline,
+    cancelled,
+    hook,
+};
+
+inline const char* search_stop_name(SearchStop stop)
+{
+    switch (stop)
+    {
+    case SearchStop::solved:
+        return "solved";
+    case SearchStop::generations:
+        return "generations";
+    case SearchStop::evaluations:
+        return "evaluations";
+    case SearchStop::deadline:
+        return "deadline";
+    case SearchStop::cancelled:
+        return "cancelled";
+    default:
+        return "hook";
+    }
+}
+
+// Copies share one flag, so a token handed to a search is cancelled from
+// any thread through another copy.
+class CancelToken
+{
+public:
+    CancelToken() : flag_(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void cancel() const noexcept { flag_->store(true, std::memory_order_relaxed); }
+    bool cancelled() const noexcept { return flag_->load(std::memory_order_relaxed); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> flag_;
+};
+
+// A point on the steady clock, or never.
+class Deadline
+{
+public:
+    Deadline() = default;
+
+    static Deadline after(std::chrono::steady_clock::duration budget)
+    {
+        Deadline deadline;
+        deadline.set_ = true;
+        deadline.at_ = std::chrono::steady_clock::now() + budget;
+        return deadline;
+    }
+
+    bool expired() const { return set_ && std::chrono::steady_clock::now() >= at_; }
+
+private:
+    bool set_ = false;
+    std::chrono::steady_clock::time_point at_;
+};
+
+// The latest of a stream of values, each with a version counting from 1,
+// for a reader polling or waiting on another thread.
+template <class T>
+class LatestValue
+{
+public:
+    void publish(T value)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            value_ = std::move(value);
+            version_++;
+        }
+        changed_.notify_all();
+    }
+
+    // Closes the stream: waiters return whether or not a value came.
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        changed_.notify_all();
+    }
+
+    // 0 before the first value.
+    std::uint64_t version() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return version_;
+    }
+
+    // The current value and its version.
+    std::uint64_t get(T &value) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        value = value_;
+        return version_;
+    }
+
+    // Waits until a version after `seen` or the end of the stream, at most
+    // `timeout`; returns the version got, `seen` if none came.
+    template <class Rep, class Period>
+    std::uint64_t wait_newer(std::uint64_t seen, T &value, std::chrono::duration<Rep, Period> timeout) const
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait_for(lock, timeout, [this, seen] { return version_ > seen || closed_; });
+        if (version_ <= seen)
+        {
+            return seen;
+        }
+        value = value_;
+        return version_;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    mutable std::condition_variable changed_;
+    T value_{};
+    std::uint64_t version_ = 0;
+    bool closed_ = false;
+};
+
+#endif  // SEARCH_CONTROL_H
@@ -0,0 +1,159 @@
+#ifndef SELECTION_H
+#define SELECTION_H
+
+// Ranking of a scored population and the choice of parents for breeding.
+//
+// Every mode puts the `elite` lowest scores (or `parents`, if more) first
+// and in order, which is all the search and its hooks look at; the rest of
+// the ranking stays in no particular order. That takes nth_element and a sort
+// of the elite instead of a sort of everything. The modes differ in how
+// parents are picked:
+//   sort          everything sorted, parents uniform among the best
+//                 `parents`; what the search used to do
+//   truncation    parents uniform among the best `parents`
+//   tournament    the best of `tournament_size` uniform draws from the
+//                 whole population
+//   proportional  drawn with probability proportional to 1 / (1 + score)
+//                 from an alias table built over the whole population
+//
+// pick() is const and draws from the caller's generator, so breeding
+// threads may share one Selector.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rng.h"
+
+enum class SelectionMode
+{
+    sort,
+    truncation,
+    tournament,
+    proportional
+};
+
+inline const char* selection_mode_name(SelectionMode mode)
+{
+    switch (mode)
+    {
+    case SelectionMode::sort: return "sort";
+    case SelectionMode::truncation: return "truncation";
+    case SelectionMode::tournament: return "tournament";
+    case SelectionMode::proportional: return "proportional";
+    }
+    return "?";
+}
+
+inline SelectionMode parse_selection_mode(const std::string &name)
+{
+    for (SelectionMode mode : { SelectionMode::sort, SelectionMode::truncation, SelectionMode::tournament, SelectionMode::proportional })
+    {
+        if (name == selection_mode_name(mode))
+        {
+            return mode;
+        }
+    }
+    throw std::invalid_argument("unknown selection mode: " + name);
+}
+
+class Selector
+{
+public:
+    // Score and population index; lower scores are better.
+    using Entry = std::pair<double, std::size_t>;
+
+    Selector(SelectionMode mode, std::size_t elite, std::size_t parents, unsigned tournament_size = 4)
+        : mode_(mode), elite_(elite), parents_(parents), tournament_size_(tournament_size != 0 ? tournament_size : 1)
+    {
+    }
+
+    SelectionMode mode() const noexcept { return mode_; }
+
+    // The ranking must stay alive and unchanged while parents are picked.
+    void rank(Entry *first, Entry *last)
+    {
+        const auto better = [](const Entry &l, const Entry &r) { return l.first < r.first; };
+        ranking_ = first;
+        size_ = (std::size_t)(last - first);
+        if (mode_ == SelectionMode::sort)
+        {
+            std::sort(first, last, better);
+        }
+        else
+        {
+            Entry *const top = first + std::min(std::max(elite_, parents_), size_);
+            if (top != last)
+            {
+                std::nth_element(first, top, last, better);
+            }
+            std::sort(first, top, better);
+        }
+        if (mode_ == SelectionMode::proportional)
+        {
+            build_weights();
+        }
+    }
+
+    // Position in the ranking of the next parent.
+    std::size_t pick(Xoshiro256 &rng = thread_rng()) const
+    {
+        switch (mode_)
+        {
+        case SelectionMode::tournament:
+        {
+            std::size_t best = rng.bounded((std::uint32_t)size_);
+            for (unsigned round = 1; round < tournament_size_; round++)
+            {
+                const std::size_t other = rng.bounded((std::uint32_t)size_);
+                if (ranking_[other].first < ranking_[best].first)
+                {
+                    best = other;
+                }
+            }
+            return best;
+        }
+        case SelectionMode::proportional:
+            return weights_.sample(rng);
+        default:
+            return rng.bounded((std::uint32_t)std::min(parents_, size_));
+        }
+    }
+
+private:
+    // Integer weights summing to at most 2^32 - 1. Individuals ranked
+    // last with an infinite score are never picked, unless all are.
+    void build_weights()
+    {
+        const double scale = std::floor((double)UINT32_MAX / size_);
+        scratch_.resize(size_);
+        bool any = false;
+        for (std::size_t i = 0; i < size_; i++)
+        {
+            const double score = ranking_[i].first;
+            scratch_[i] = std::isinf(score) ? 0 : std::max<std::uint32_t>(1, (std::uint32_t)(scale / (1. + score)));
+            any |= scratch_[i] != 0;
+        }
+        if (!any)
+        {
+            std::fill(scratch_.begin(), scratch_.end(), 1u);
+        }
+        weights_.assign(scratch_);
+    }
+
+    SelectionMode mode_;
+    std::size_t elite_;
+    std::size_t parents_;
+    unsigned tournament_size_;
+    const Entry *ranking_ = nullptr;
+    std::size_t size_ = 0;
+    std::vector<std::uint32_t> scratch_;
+    DynamicAliasTable weights_;
+};
+
+#endif  // SELECTION_H
@@ -0,0 +1,75 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+// Read-only view of a run of sequence terms, what std::span<const int> is
+// in C++20. Arrays and vectors convert to it implicitly, so searches take
+// targets of any length without being templated on it.
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class SequenceView
+{
+public:
+    constexpr SequenceView() noexcept = default;
+    constexpr SequenceView(const int *data, std::size_t size) noexcept : data_(data), size_(size) {}
+
+    template <std::size_t N>
+    constexpr SequenceView(const std::array<int, N> &terms) noexcept : data_(terms.data()), size_(N) {}
+
+    SequenceView(const std::vector<int> &terms) noexcept : data_(terms.data()), size_(terms.size()) {}
+
+    constexpr const int* data() const noexcept { return data_; }
+    constexpr std::size_t size() const noexcept { return size_; }
+    constexpr bool empty() const noexcept { return size_ == 0; }
+
+    constexpr const int* begin() const noexcept { return data_; }
+    constexpr const int* end() const noexcept { return data_ + size_; }
+
+    constexpr const int& operator[](std::size_t i) const noexcept { return data_[i]; }
+
+private:
+    const int *data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+// Terms separated by commas and/or spaces, "0, 4, 30, 120". Throws
+// std::invalid_argument on anything else, terms that do not fit an int
+// included.
+inline std::vector<int> parse_sequence(const std::string &text)
+{
+    std::vector<int> terms;
+    std::size_t pos = 0;
+    while (true)
+    {
+        pos = text.find_first_not_of(", \t\r\n", pos);
+        if (pos == std::string::npos)
+        {
+            break;
+        }
+        const std::size_t end = std::min(text.find_first_of(", \t\r\n", pos), text.size());
+        const std::string term = text.substr(pos, end - pos);
+        std::size_t used = 0;
+        try
+        {
+            terms.push_back(std::stoi(term, &used));
+        }
+        catch (const std::logic_error&)
+        {
+            used = 0;
+        }
+        if (used != term.size())
+        {
+            throw std::invalid_argument("not an int sequence term: " + term);
+        }
+        pos = end;
+    }
+    return terms;
+}
+
+#endif  // SEQUENCE_H
@@ -0,0 +1,649 @@
+#ifndef SIMD_EVAL_H
+#define SIMD_EVAL_H
+
+// Scores many programs in lockstep, one program per SIMD lane.
+//
+// Every program of a batch is lowered to register form: slots 0..3 hold
+// zero, n, xp and xpp, operation k writes slot 4 + k, and leaf j of the
+// postfix order owns slot 4 + ops + j. The slot table is column-per-lane,
+// so a lane only ever reads its own column and the operation itself is
+// picked per lane with a blend.
+//
+// Batches are only ever formed from programs of one shape (the same
+// postfix pattern of leaves and operations, see shape_key), which makes
+// every operand row refer to the same slot in all lanes: operands are
+// always plain vector loads, and there is no gather path. Lanes of a row
+// can still disagree on which operation or leaf it is; such a row is
+// computed for every kind present and blended per lane. A shape with a
+// single program goes to the interpreter instead, as does a program
+// reading Lag or Sum, which have no lane kind.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include "bytecode.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEQGEN_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+enum class SimdLevel
+{
+    Scalar,
+    AVX2,
+    AVX512
+};
+
+inline SimdLevel detect_simd_level()
+{
+#if defined(SEQGEN_X86_SIMD)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        return SimdLevel::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return SimdLevel::AVX2;
+    }
+#endif
+    return SimdLevel::Scalar;
+}
+
+inline const char* simd_level_name(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::AVX512:
+        return "AVX-512";
+    case SimdLevel::AVX2:
+        return "AVX2";
+    default:
+        return "scalar";
+    }
+}
+
+namespace simd_detail
+{
+
+// Row kinds: leaves first, so that a leaf kind is also the reserved slot
+// holding its variable, then the operations, in the order of OpCode.
+// Batches take programs in N, XP and XPP only: lags and sums have no slot
+// and run on the interpreter.
+enum RowKind : std::int32_t
+{
+    row_value,
+    row_n,
+    row_xp,
+    row_xpp,
+    row_lag,
+    row_sum,
+    row_plus,
+    row_minus,
+    row_mul
+};
+
+constexpr std::int32_t reserved_slots = 4;
+constexpr std::int32_t varying = -1;
+
+// Lag and Sum leaves have no lane kind; such programs run on their own.
+inline bool reads_history(const Program &program)
+{
+    return std::any_of(program.code().begin(), program.code().end(),
+        [](const Instr &instr) { return instr.op == OpCode::Lag || instr.op == OpCode::Sum; });
+}
+
+// Postfix pattern of leaves and operations; programs with equal keys lower
+// to identical operand rows.
+inline std::uint64_t shape_key(const Program &program)
+{
+    std::uint64_t key = 14695981039346656037ull;
+    for (const Instr &instr : program.code())
+    {
+        key = (key ^ (instr.op >= OpCode::Plus ? 2u : 1u)) * 1099511628211ull;
+    }
+    return key;
+}
+
+// Output fingerprint: two 32-bit multiplicative hashes over the generated
+// terms, cheap enough to keep in vector registers next to the error.
+constexpr std::uint32_t fingerprint_basis1 = 2166136261u;
+constexpr std::uint32_t fingerprint_prime1 = 16777619u;
+constexpr std::uint32_t fingerprint_basis2 = 0x9747b28cu;
+constexpr std::uint32_t fingerprint_prime2 = 0x85ebca6bu;
+
+inline void fingerprint_step(std::uint32_t &h1, std::uint32_t &h2, int term)
+{
+    h1 = (h1 ^ (std::uint32_t)term) * fingerprint_prime1;
+    h2 = (h2 + (std::uint32_t)term) * fingerprint_prime2;
+}
+
+inline std::uint64_t fingerprint_value(std::uint32_t h1, std::uint32_t h2)
+{
+    return ((std::uint64_t)h1 << 32) | h2;
+}
+
+// A row of the slot table recomputed on every step: an operation, or a
+// leaf that is a different variable or constant in different lanes. Leaf
+// rows that agree in all lanes never show up here, they are filled once or
+// read straight from the reserved slots. `kind` is `varying` when lanes
+// disagree and the result has to be blended.
+struct Task
+{
+    std::int32_t row;
+    std::int32_t kind;
+    std::int32_t lhs;
+    std::int32_t rhs;
+};
+
+// One batch of programs of the same shape in register form. Instruction p
+// writes slot reserved_slots + p, so operand slots are common to all lanes.
+struct Batch
+{
+    std::size_t lanes = 0;
+    std::vector<std::int32_t> kind;
+    std::vector<std::int32_t> consts;
+    std::vector<Task> tasks;
+    std::int32_t root = 0;
+    std::vector<std::int32_t> slots;
+    std::vector<std::int32_t> remap;
+    std::vector<std::int32_t> stack;
+    std::vector<int> xp;
+    std::vector<int> xpp;
+    std::vector<std::uint64_t> acc;
+    std::vector<std::uint32_t> h1;
+    std::vector<std::uint32_t> h2;
+
+    // Idle lanes past `count` repeat the first program.
+    void build(const Program *const *programs, std::size_t count, std::size_t width)
+    {
+        const std::size_t W = width;
+        const std::vector<Instr> &shape = programs[0]->code();
+        const std::size_t rows = shape.size();
+        lanes = W;
+        kind.resize(rows * W);
+        slots.assign((reserved_slots + rows) * W, 0);
+        xp.resize(W);
+        xpp.resize(W);
+        acc.assign(W, 0);
+        h1.assign(W, fingerprint_basis1);
+        h2.assign(W, fingerprint_basis2);
+        for (std::size_t l = 0; l < W; l++)
+        {
+            const std::vector<Instr> &code = programs[l < count ? l : 0]->code();
+            for (std::size_t p = 0; p < rows; p++)
+            {
+                kind[p * W + l] = (std::int32_t)code[p].op;
+                slots[(reserved_slots + p) * W + l] = code[p].arg;
+            }
+        }
+
+        remap.resize(reserved_slots + rows);
+        std::iota(remap.begin(), remap.end(), 0);
+        stack.resize(programs[0]->stack_depth() + 1);
+        std::int32_t *sp = stack.data();
+        tasks.clear();
+        consts.clear();
+        for (std::size_t p = 0; p < rows; p++)
+        {
+            const std::int32_t *k = kind.data() + p * W;
+            bool same = true;
+            for (std::size_t l = 1; l < W; l++)
+            {
+                same &= k[l] == k[0];
+            }
+            const std::int32_t slot = reserved_slots + (std::int32_t)p;
+            if (shape[p].op >= OpCode::Plus)
+            {
+                const std::int32_t rhs = *--sp;
+                const std::int32_t lhs = *--sp;
+                tasks.push_back(Task{ (std::int32_t)p, same ? k[0] : varying, lhs, rhs });
+            }
+            else if (!same)
+            {
+                tasks.push_back(Task{ (std::int32_t)p, varying, 0, 0 });
+                consts.insert(consts.end(), slots.begin() + slot * W, slots.begin() + (slot + 1) * W);
+            }
+            else if (k[0] != row_value)
+            {
+                remap[slot] = k[0];
+            }
+            *sp++ = remap[slot];
+        }
+        root = sp[-1];
+    }
+};
+
+// The kernels stop once every lane's error is past `limit`.
+inline void kernel_scalar(Batch &b, const int *target, std::size_t len, std::uint64_t limit)
+{
+    const std::size_t W = b.lanes;
+    std::int32_t *slots = b.slots.data();
+    for (std::size_t l = 0; l < W; l++)
+    {
+        b.xpp[l] = target[0];
+        b.xp[l] = target[1];
+    }
+    for (std::size_t i = 2; i < len; i++)
+    {
+        for (std::size_t l = 0; l < W; l++)
+        {
+            slots[row_n * W + l] = (int)(i + 1);
+            slots[row_xp * W + l] = b.xp[l];
+            slots[row_xpp * W + l] = b.xpp[l];
+        }
+        const std::int32_t *consts = b.consts.data();
+        for (const Task &task : b.tasks)
+        {
+            std::int32_t *dst = slots + (reserved_slots + task.row) * W;
+            const std::int32_t *lhs = slots + task.lhs * W;
+            const std::int32_t *rhs = slots + task.rhs * W;
+            const std::int32_t *kind = b.kind.data() + task.row * W;
+            for (std::size_t l = 0; l < W; l++)
+            {
+                switch (kind[l])
+                {
+                case row_value:
+                    dst[l] = consts[l];
+                    break;
+                case row_n:
+                case row_xp:
+                case row_xpp:
+                    dst[l] = slots[kind[l] * W + l];
+                    break;
+                case row_plus:
+                    dst[l] = wrapping_add(lhs[l], rhs[l]);
+                    break;
+                case row_minus:
+                    dst[l] = wrapping_sub(lhs[l], rhs[l]);
+                    break;
+                default:
+                    dst[l] = wrapping_mul(lhs[l], rhs[l]);
+                    break;
+                }
+            }
+            if (kind[0] < row_plus)
+            {
+                consts += W;
+            }
+        }
+        bool done = true;
+        for (std::size_t l = 0; l < W; l++)
+        {
+            const int res = slots[b.root * W + l];
+            b.acc[l] = saturating_add(b.acc[l], squared_diff(res, target[i]));
+            done &= b.acc[l] > limit;
+            fingerprint_step(b.h1[l], b.h2[l], res);
+            b.xpp[l] = b.xp[l];
+            b.xp[l] = res;
+        }
+        if (done)
+        {
+            break;
+        }
+    }
+}
+
+#if defined(SEQGEN_X86_SIMD)
+
+// Squares of the wrapped differences in 64-bit lanes, four of them per
+// half. There are no unsigned 64-bit compares before AVX-512, so the
+// sign bit is flipped to compare as signed.
+__attribute__((target("avx2")))
+inline __m256i saturating_add_avx2(__m256i acc, __m256i sq)
+{
+    const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+    const __m256i sum = _mm256_add_epi64(acc, sq);
+    return _mm256_or_si256(sum, _mm256_cmpgt_epi64(_mm256_xor_si256(acc, sign), _mm256_xor_si256(sum, sign)));
+}
+
+__attribute__((target("avx2")))
+inline bool above_avx2(__m256i acc, __m256i limit)
+{
+    const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+    return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_xor_si256(acc, sign), _mm256_xor_si256(limit, sign)))) == 0xf;
+}
+
+__attribute__((target("avx2")))
+inline void kernel_avx2(Batch &b, const int *target, std::size_t len, std::uint64_t limit)
+{
+    constexpr std::size_t W = 8;
+    std::int32_t *slots = b.slots.data();
+#define row_at(slot) ((__m256i*)(slots + (slot) * W))
+    __m256i xpp = _mm256_set1_epi32(target[0]);
+    __m256i xp = _mm256_set1_epi32(target[1]);
+    const __m256i limits = _mm256_set1_epi64x((long long)limit);
+    __m256i acc_lo = _mm256_setzero_si256();
+    __m256i acc_hi = _mm256_setzero_si256();
+    __m256i h1 = _mm256_set1_epi32((int)fingerprint_basis1);
+    __m256i h2 = _mm256_set1_epi32((int)fingerprint_basis2);
+    for (std::size_t i = 2; i < len; i++)
+    {
+        const __m256i n = _mm256_set1_epi32((int)(i + 1));
+        _mm256_storeu_si256(row_at(row_n), n);
+        _mm256_storeu_si256(row_at(row_xp), xp);
+        _mm256_storeu_si256(row_at(row_xpp), xpp);
+        const std::int32_t *consts = b.consts.data();
+        for (const Task &task : b.tasks)
+        {
+            const __m256i lhs = _mm256_loadu_si256(row_at(task.lhs));
+            const __m256i rhs = _mm256_loadu_si256(row_at(task.rhs));
+            __m256i res;
+            switch (task.kind)
+            {
+            case row_plus:
+                res = _mm256_add_epi32(lhs, rhs);
+                break;
+            case row_minus:
+                res = _mm256_sub_epi32(lhs, rhs);
+                break;
+            case row_mul:
+                res = _mm256_mullo_epi32(lhs, rhs);
+                break;
+            default:
+            {
+                const __m256i kind = _mm256_loadu_si256((const __m256i*)(b.kind.data() + task.row * W));
+                if (b.kind[task.row * W] >= row_plus)
+                {
+                    res = _mm256_add_epi32(lhs, rhs);
+                    res = _mm256_blendv_epi8(res, _mm256_sub_epi32(lhs, rhs), _mm256_cmpeq_epi32(kind, _mm256_set1_epi32(row_minus)));
+                    res = _mm256_blendv_epi8(res, _mm256_mullo_epi32(lhs, rhs), _mm256_cmpeq_epi32(kind, _mm256_set1_epi32(row_mul)));
+                }
+                else
+                {
+                    res = _mm256_loadu_si256((const __m256i*)consts);
+                    res = _mm256_blendv_epi8(res, n, _mm256_cmpeq_epi32(kind, _mm256_set1_epi32(row_n)));
+                    res = _mm256_blendv_epi8(res, xp, _mm256_cmpeq_epi32(kind, _mm256_set1_epi32(row_xp)));
+                    res = _mm256_blendv_epi8(res, xpp, _mm256_cmpeq_epi32(kind, _mm256_set1_epi32(row_xpp)));
+                    consts += W;
+                }
+                break;
+            }
+            }
+            _mm256_storeu_si256(row_at(reserved_slots + task.row), res);
+        }
+        const __m256i res = _mm256_loadu_si256(row_at(b.root));
+        const __m256i diff = _mm256_sub_epi32(res, _mm256_set1_epi32(target[i]));
+        const __m256i diff_lo = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(diff));
+        const __m256i diff_hi = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(diff, 1));
+        acc_lo = saturating_add_avx2(acc_lo, _mm256_mul_epi32(diff_lo, diff_lo));
+        acc_hi = saturating_add_avx2(acc_hi, _mm256_mul_epi32(diff_hi, diff_hi));
+        h1 = _mm256_mullo_epi32(_mm256_xor_si256(h1, res), _mm256_set1_epi32((int)fingerprint_prime1));
+        h2 = _mm256_mullo_epi32(_mm256_add_epi32(h2, res), _mm256_set1_epi32((int)fingerprint_prime2));
+        xpp = xp;
+        xp = res;
+        if (above_avx2(acc_lo, limits) && above_avx2(acc_hi, limits))
+        {
+            break;
+        }
+    }
+    _mm256_storeu_si256((__m256i*)b.acc.data(), acc_lo);
+    _mm256_storeu_si256((__m256i*)(b.acc.data() + 4), acc_hi);
+    _mm256_storeu_si256((__m256i*)b.h1.data(), h1);
+    _mm256_storeu_si256((__m256i*)b.h2.data(), h2);
+#undef row_at
+}
+
+__attribute__((target("avx512f")))
+inline __m512i saturating_add_avx512(__m512i acc, __m512i sq)
+{
+    const __m512i sum = _mm512_add_epi64(acc, sq);
+    return _mm512_mask_mov_epi64(sum, _mm512_cmplt_epu64_mask(sum, acc), _mm512_set1_epi64(-1));
+}
+
+__attribute__((target("avx512f")))
+inline void kernel_avx512(Batch &b, const int *target, std::size_t len, std::uint64_t limit)
+{
+    constexpr std::size_t W = 16;
+    std::int32_t *slots = b.slots.data();
+#define row_at(slot) (slots + (slot) * W)
+    __m512i xpp = _mm512_set1_epi32(target[0]);
+    __m512i xp = _mm512_set1_epi32(target[1]);
+    const __m512i limits = _mm512_set1_epi64((long long)limit);
+    __m512i acc_lo = _mm512_setzero_si512();
+    __m512i acc_hi = _mm512_setzero_si512();
+    __m512i h1 = _mm512_set1_epi32((int)fingerprint_basis1);
+    __m512i h2 = _mm512_set1_epi32((int)fingerprint_basis2);
+    for (std::size_t i = 2; i < len; i++)
+    {
+        const __m512i n = _mm512_set1_epi32((int)(i + 1));
+        _mm512_storeu_si512(row_at(row_n), n);
+        _mm512_storeu_si512(row_at(row_xp), xp);
+        _mm512_storeu_si512(row_at(row_xpp), xpp);
+        const std::int32_t *consts = b.consts.data();
+        for (const Task &task : b.tasks)
+        {
+            const __m512i lhs = _mm512_loadu_si512(row_at(task.lhs));
+            const __m512i rhs = _mm512_loadu_si512(row_at(task.rhs));
+            __m512i res;
+            switch (task.kind)
+            {
+            case row_plus:
+                res = _mm512_add_epi32(lhs, rhs);
+                break;
+            case row_minus:
+                res = _mm512_sub_epi32(lhs, rhs);
+                break;
+            case row_mul:
+                res = _mm512_mullo_epi32(lhs, rhs);
+                break;
+            default:
+            {
+                const __m512i kind = _mm512_loadu_si512(b.kind.data() + task.row * W);
+                if (b.kind[task.row * W] >= row_plus)
+                {
+                    res = _mm512_add_epi32(lhs, rhs);
+                    res = _mm512_mask_blend_epi32(_mm512_cmpeq_epi32_mask(kind, _mm512_set1_epi32(row_minus)), res, _mm512_sub_epi32(lhs, rhs));
+                    res = _mm512_mask_blend_epi32(_mm512_cmpeq_epi32_mask(kind, _mm512_set1_epi32(row_mul)), res, _mm512_mullo_epi32(lhs, rhs));
+                }
+                else
+                {
+                    res = _mm512_loadu_si512(consts);
+                    res = _mm512_mask_blend_epi32(_mm512_cmpeq_epi32_mask(kind, _mm512_set1_epi32(row_n)), res, n);
+                    res = _mm512_mask_blend_epi32(_mm512_cmpeq_epi32_mask(kind, _mm512_set1_epi32(row_xp)), res, xp);
+                    res = _mm512_mask_blend_epi32(_mm512_cmpeq_epi32_mask(kind, _mm512_set1_epi32(row_xpp)), res, xpp);
+                    consts += W;
+                }
+                break;
+            }
+            }
+            _mm512_storeu_si512(row_at(reserved_slots + task.row), res);
+        }
+        const __m512i res = _mm512_loadu_si512(row_at(b.root));
+        const __m512i diff = _mm512_sub_epi32(res, _mm512_set1_epi32(target[i]));
+        const __m512i diff_lo = _mm512_cvtepi32_epi64(_mm512_castsi512_si256(diff));
+        const __m512i diff_hi = _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(diff, 1));
+        acc_lo = saturating_add_avx512(acc_lo, _mm512_mul_epi32(diff_lo, diff_lo));
+        acc_hi = saturating_add_avx512(acc_hi, _mm512_mul_epi32(diff_hi, diff_hi));
+        h1 = _mm512_mullo_epi32(_mm512_xor_si512(h1, res), _mm512_set1_epi32((int)fingerprint_prime1));
+        h2 = _mm512_mullo_epi32(_mm512_add_epi32(h2, res), _mm512_set1_epi32((int)fingerprint_prime2));
+        xpp = xp;
+        xp = res;
+        if ((_mm512_cmpgt_epu64_mask(acc_lo, limits) & _mm512_cmpgt_epu64_mask(acc_hi, limits)) == 0xff)
+        {
+            break;
+        }
+    }
+    _mm512_storeu_si512(b.acc.data(), acc_lo);
+    _mm512_storeu_si512(b.acc.data() + 8, acc_hi);
+    _mm512_storeu_si512(b.h1.data(), h1);
+    _mm512_storeu_si512(b.h2.data(), h2);
+#undef row_at
+}
+
+#endif
+
+}  // namespace simd_detail
+
+// Hash of seq[2..len), the terms generated after the two seeds. Programs
+// with equal fingerprints on a target compute the same sequence there (up
+// to hash collisions) and have the same error. Every evaluation path
+// produces the same value.
+inline std::uint64_t output_fingerprint(const int *seq, std::size_t len)
+{
+    std::uint32_t h1 = simd_detail::fingerprint_basis1;
+    std::uint32_t h2 = simd_detail::fingerprint_basis2;
+    for (std::size_t i = 2; i < len; i++)
+    {
+        simd_detail::fingerprint_step(h1, h2, seq[i]);
+    }
+    return simd_detail::fingerprint_value(h1, h2);
+}
+
+// The same over the values of an arithmetic domain, see arithmetic.h,
+// a 32-bit word at a time; for int it is output_fingerprint.
+template <class Value>
+inline std::uint64_t output_fingerprint_of(const Value *seq, std::size_t len)
+{
+    static_assert(sizeof(Value) % sizeof(std::uint32_t) == 0, "values of whole 32-bit words");
+    std::uint32_t h1 = simd_detail::fingerprint_basis1;
+    std::uint32_t h2 = simd_detail::fingerprint_basis2;
+    for (std::size_t i = 2; i < len; i++)
+    {
+        std::uint32_t words[sizeof(Value) / sizeof(std::uint32_t)];
+        std::memcpy(words, &seq[i], sizeof(Value));
+        for (std::uint32_t word : words)
+        {
+            simd_detail::fingerprint_step(h1, h2, (int)word);
+        }
+    }
+    return simd_detail::fingerprint_value(h1, h2);
+}
+
+// Squared error between the sequence each program generates from
+// target[0], target[1] and the target itself, for a whole population.
+class BatchEvaluator
+{
+public:
+    explicit BatchEvaluator(SimdLevel level = detect_simd_level()) : level_(level) {}
+
+    SimdLevel level() const noexcept { return level_; }
+    std::size_t lanes() const noexcept { return level_ == SimdLevel::AVX512 ? 16 : 8; }
+
+    // Output fingerprints go to `fingerprints` if it is not null. A batch
+    // is cut short once all of its programs are past `limit`; their errors
+    // are then lower bounds and their fingerprints cover only the terms
+    // computed. Programs reading Lag or Sum run on the interpreter, and
+    // those reading further back than XPP, which two seed terms cannot
+    // start, get the error UINT64_MAX without running.
+    void evaluate(const std::vector<const Program*> &programs, const int *target, std::size_t len, std::uint64_t *errors,
+                  std::uint64_t *fingerprints = nullptr, std::uint64_t limit = UINT64_MAX)
+    {
+        order_.clear();
+        for (std::size_t i = 0; i < programs.size(); i++)
+        {
+            if (!simd_detail::reads_history(*programs[i]))
+            {
+                order_.emplace_back(simd_detail::shape_key(*programs[i]), i);
+                continue;
+            }
+            if (programs[i]->lookback() > 2)
+            {
+                errors[i] = UINT64_MAX;
+                if (fingerprints != nullptr)
+                {
+                    fingerprints[i] = simd_detail::fingerprint_value(simd_detail::fingerprint_basis1, simd_detail::fingerprint_basis2);
+                }
+                continue;
+            }
+            lane_programs_[0] = programs[i];
+            run(1, target, len, limit);
+            errors[i] = batch_.acc[0];
+            if (fingerprints != nullptr)
+            {
+                fingerprints[i] = simd_detail::fingerprint_value(batch_.h1[0], batch_.h2[0]);
+            }
+        }
+        std::sort(order_.begin(), order_.end());
+
+        const std::size_t count = order_.size();
+        for (std::size_t first = 0; first < count;)
+        {
+            std::size_t last = first + 1;
+            while (last < count && order_[last].first == order_[first].first)
+            {
+                ++last;
+            }
+            for (std::size_t begin = first; begin < last; begin += lanes())
+            {
+                const std::size_t n = std::min(lanes(), last - begin);
+                for (std::size_t l = 0; l < n; l++)
+                {
+                    lane_programs_[l] = programs[order_[begin + l].second];
+                }
+                run(n, target, len, limit);
+                for (std::size_t l = 0; l < n; l++)
+                {
+                    errors[order_[begin + l].second] = batch_.acc[l];
+                    if (fingerprints != nullptr)
+                    {
+                        fingerprints[order_[begin + l].second] = simd_detail::fingerprint_value(batch_.h1[l], batch_.h2[l]);
+                    }
+                }
+            }
+            first = last;
+        }
+    }
+
+private:
+    // Targets from this length on run lone programs staged. Below it the
+    // columns cost more than the steps the error limit cuts off.
+    static constexpr std::size_t staged_length = 16;
+
+    // A lone program of its shape is cheaper on the interpreter, and a
+    // short group does not need the widest vectors.
+    void run(std::size_t n, const int *target, std::size_t len, std::uint64_t limit)
+    {
+        if (n == 1)
+        {
+            seq_.assign(len, 0);
+            seq_[0] = target[0];
+            seq_[1] = target[1];
+            const Program &program = *lane_programs_[0];
+            if (len >= staged_length)
+            {
+                staged_.build(program);
+                batch_.acc.assign(1, staged_.run_scored(seq_.data(), target, len, limit));
+            }
+            else
+            {
+                batch_.acc.assign(1, program.run_scored(seq_.data(), target, len, limit));
+            }
+            const std::uint64_t fingerprint = output_fingerprint(seq_.data(), len);
+            batch_.h1.assign(1, (std::uint32_t)(fingerprint >> 32));
+            batch_.h2.assign(1, (std::uint32_t)fingerprint);
+            return;
+        }
+#if defined(SEQGEN_X86_SIMD)
+        if (level_ == SimdLevel::AVX512 && n > 8)
+        {
+            batch_.build(lane_programs_, n, 16);
+            simd_detail::kernel_avx512(batch_, target, len, limit);
+            return;
+        }
+        if (level_ >= SimdLevel::AVX2)
+        {
+            batch_.build(lane_programs_, n, 8);
+            simd_detail::kernel_avx2(batch_, target, len, limit);
+            return;
+        }
+#endif
+        batch_.build(lane_programs_, n, 8);
+        simd_detail::kernel_scalar(batch_, target, len, limit);
+    }
+
+    SimdLevel level_;
+    simd_detail::Batch batch_;
+    StagedProgram staged_;
+    std::vector<std::pair<std::uint64_t, std::size_t>> order_;
+    std::vector<int> seq_;
+    const Program *lane_programs_[16] = {};
+};
+
+#endif  // SIMD_EVAL_H
@@ -0,0 +1,411 @@
+#ifndef SOLUTION_STORE_H
+#define SOLUTION_STORE_H
+
+// Formulas of solved sequences, in a file mapped into memory so they
+// outlive the process.
+//
+// A sequence is indexed under its terms and under each of its prefixes at
+// least `min_prefix` terms long, so a lookup also finds the sequences the
+// target starts like and those that start like the target. Keys are the
+// terms as they are: a formula is a recurrence from the first two terms,
+// so there is nothing to normalize them to without changing what it
+// computes. The formula is kept as opaque bytes, the prefix encoding of
+// checkpoint.h for the search.
+//
+// The file is
+//   Header, 64 bytes
+//   slot_count Slots, an open-addressing table of (tag, record) pairs
+//   data_capacity bytes of records: u32 terms, u32 formula bytes, the
+//       terms as i32, the formula, padded to 4 bytes
+// in host byte order. A lookup hashes each prefix of the target, longest
+// first, and compares terms only on slots whose 32-bit tag matches, so it
+// touches a few cache lines per prefix whatever the size of the store.
+// Records are only ever appended; the table is rebuilt in a new file
+// twice as large when it is half full, and the data area grows in place.
+//
+// One process at a time: opening takes an exclusive lock on the file.
+// Threads of that process may share the store.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "rng.h"
+#include "sequence.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class SolutionStore
+{
+public:
+    static constexpr std::size_t min_prefix = 5;
+    // Records indexed under one key at most; further sequences sharing
+    // that prefix are found by their longer ones only.
+    static constexpr std::size_t max_per_key = 4;
+
+    struct Match
+    {
+        // Leading terms the stored sequence has in common with the target.
+        std::size_t common;
+        std::vector<int> terms;
+        std::vector<std::uint8_t> formula;
+    };
+
+    // Opens the store at `path`, creating it if there is none. Throws
+    // std::runtime_error if it cannot, if the file is not a store, or if
+    // another process has it open.
+    explicit SolutionStore(const std::string &path) : path_(path)
+    {
+        open_file(path_);
+    }
+
+    SolutionStore(const SolutionStore&) = delete;
+    SolutionStore& operator=(const SolutionStore&) = delete;
+
+    ~SolutionStore()
+    {
+        close_file();
+    }
+
+    // Sequences stored, counting each formula of one sequence.
+    std::uint64_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return header()->records;
+    }
+
+    // False if the sequence is already there with the same formula.
+    bool insert(SequenceView terms, const std::vector<std::uint8_t> &formula)
+    {
+        if (terms.size() < min_prefix)
+        {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        const std::uint64_t full = key_of(terms, terms.size());
+        for (std::uint32_t slot = first_slot(full); slots()[slot].tag != 0; slot = next_slot(slot))
+        {
+            const std::uint32_t record = slots()[slot].record;
+            if (slots()[slot].tag == tag_of(full) && record_terms(record) == terms.size()
+                && std::memcmp(record_data(record), terms.data(), terms.size() * 4) == 0
+                && record_formula_size(record) == formula.size()
+                && std::memcmp(record_formula(record), formula.data(), formula.size()) == 0)
+            {
+                return false;
+            }
+        }
+
+        const std::uint64_t bytes = record_bytes(terms.size(), formula.size());
+        if (header()->data_size + bytes > header()->data_capacity)
+        {
+            grow_data(std::max(2 * header()->data_capacity, header()->data_size + bytes));
+        }
+        if (2 * (header()->slots_used + terms.size() - min_prefix + 1) > header()->slot_count)
+        {
+            rebuild(2 * header()->slot_count);
+        }
+
+        const std::uint64_t offset = header()->data_size;
+        if (offset / 4 > UINT32_MAX)
+        {
+            throw std::runtime_error("solution store: " + path_ + " is full");
+        }
+        std::uint8_t *record = data() + offset;
+        const std::uint32_t sizes[2] = { (std::uint32_t)terms.size(), (std::uint32_t)formula.size() };
+        std::memcpy(record, sizes, sizeof(sizes));
+        std::memcpy(record + 8, terms.data(), terms.size() * 4);
+        std::memcpy(record + 8 + terms.size() * 4, formula.data(), formula.size());
+        header()->data_size += bytes;
+
+        const std::uint32_t id = (std::uint32_t)(offset / 4);
+        for (std::size_t length = terms.size(); length >= min_prefix; length--)
+        {
+            const std::uint64_t key = key_of(terms, length);
+            std::size_t indexed = 0;
+            std::uint32_t slot = first_slot(key);
+            for (; slots()[slot].tag != 0; slot = next_slot(slot))
+            {
+                indexed += slots()[slot].tag == tag_of(key) && starts_with(slots()[slot].record, terms, length);
+            }
+            if (indexed < max_per_key)
+            {
+                slots()[slot] = Slot{ tag_of(key), id };
+                header()->slots_used++;
+            }
+        }
+        header()->max_terms = std::max<std::uint64_t>(header()->max_terms, terms.size());
+        header()->records++;
+        return true;
+    }
+
+    // Stored sequences sharing at least `min_prefix` leading terms with
+    // the target, those sharing more first, at most `max_matches`.
+    std::vector<Match> lookup(SequenceView target, std::size_t max_matches = 8) const
+    {
+        std::vector<Match> matches;
+        std::vector<std::uint32_t> seen;
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (std::size_t length = std::min<std::size_t>(target.size(), header()->max_terms);
+             length >= min_prefix && matches.size() < max_matches; length--)
+        {
+            const std::uint64_t key = key_of(target, length);
+            for (std::uint32_t slot = first_slot(key); slots()[slot].tag != 0 && matches.size() < max_matches; slot = next_slot(slot))
+            {
+                const std::uint32_t record = slots()[slot].record;
+                if (slots()[slot].tag != tag_of(key) || !starts_with(record, target, length)
+                    || std::find(seen.begin(), seen.end(), record) != seen.end())
+                {
+                    continue;
+                }
+                seen.push_back(record);
+                const int *terms = record_data(record);
+                Match match;
+                match.terms.assign(terms, terms + record_terms(record));
+                match.common = length;
+                while (match.common < match.terms.size() && match.common < target.size() && match.terms[match.common] == target[match.common])
+                {
+                    match.common++;
+                }
+                match.formula.assign(record_formula(record), record_formula(record) + record_formula_size(record));
+                matches.push_back(std::move(match));
+            }
+        }
+        return matches;
+    }
+
+private:
+    static constexpr std::uint32_t magic = 0x53534753;  // "SGSS"
+    // Follows the tree format of checkpoint.h, which the formulas are in.
+    static constexpr std::uint32_t version = 2;
+    static constexpr std::uint64_t initial_slots = 1 << 16;
+    static constexpr std::uint64_t initial_data = 1 << 20;
+
+    struct Header
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint64_t slot_count;
+        std::uint64_t slots_used;
+        std::uint64_t data_capacity;
+        std::uint64_t data_size;
+        std::uint64_t records;
+        std::uint64_t max_terms;
+        std::uint64_t reserved;
+    };
+    static_assert(sizeof(Header) == 64, "store header is 64 bytes");
+
+    // A zero tag is an empty slot; `record` is the offset in the data
+    // area divided by 4.
+    struct Slot
+    {
+        std::uint32_t tag;
+        std::uint32_t record;
+    };
+
+    static std::uint64_t key_of(SequenceView terms, std::size_t length)
+    {
+        std::uint64_t key = mix64(length);
+        for (std::size_t i = 0; i < length; i++)
+        {
+            key = mix64(key ^ (std::uint32_t)terms[i]);
+        }
+        return key;
+    }
+
+    static std::uint32_t tag_of(std::uint64_t key) { return (std::uint32_t)(key >> 32) | 1; }
+
+    static std::uint64_t record_bytes(std::size_t terms, std::size_t formula)
+    {
+        return (8 + terms * 4 + formula + 3) & ~(std::uint64_t)3;
+    }
+
+    std::uint32_t first_slot(std::uint64_t key) const { return (std::uint32_t)(key & (header()->slot_count - 1)); }
+    std::uint32_t next_slot(std::uint32_t slot) const { return (std::uint32_t)((slot + 1) & (header()->slot_count - 1)); }
+
+    Header* header() const { return static_cast<Header*>(map_); }
+    Slot* slots() const { return reinterpret_cast<Slot*>(header() + 1); }
+    std::uint8_t* data() const { return reinterpret_cast<std::uint8_t*>(slots() + header()->slot_count); }
+
+    std::uint32_t record_terms(std::uint32_t record) const { return reinterpret_cast<const std::uint32_t*>(data() + 4 * (std::uint64_t)record)[0]; }
+    std::uint32_t record_formula_size(std::uint32_t record) const { return reinterpret_cast<const std::uint32_t*>(data() + 4 * (std::uint64_t)record)[1]; }
+    const int* record_data(std::uint32_t record) const { return reinterpret_cast<const int*>(data() + 4 * (std::uint64_t)record + 8); }
+    const std::uint8_t* record_formula(std::uint32_t record) const
+    {
+        return reinterpret_cast<const std::uint8_t*>(record_data(record) + record_terms(record));
+    }
+
+    bool starts_with(std::uint32_t record, SequenceView terms, std::size_t length) const
+    {
+        return record_terms(record) >= length && std::memcmp(record_data(record), terms.data(), length * 4) == 0;
+    }
+
+    static std::uint64_t file_bytes(std::uint64_t slot_count, std::uint64_t data_capacity)
+    {
+        return sizeof(Header) + slot_count * sizeof(Slot) + data_capacity;
+    }
+
+    void open_file(const std::string &path)
+    {
+        fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd_ < 0)
+        {
+            throw std::runtime_error("solution store: cannot open " + path);
+        }
+        if (flock(fd_, LOCK_EX | LOCK_NB) != 0)
+        {
+            close(fd_);
+            fd_ = -1;
+            throw std::runtime_error("solution store: " + path + " is in use");
+        }
+        struct stat st;
+        fstat(fd_, &st);
+        if (st.st_size == 0)
+        {
+            Header fresh{ magic, version, initial_slots, 0, initial_data, 0, 0, 0, 0 };
+            if (ftruncate(fd_, (off_t)file_bytes(initial_slots, initial_data)) != 0 || pwrite(fd_, &fresh, sizeof(fresh), 0) != (ssize_t)sizeof(fresh))
+            {
+                fail("cannot create " + path);
+            }
+            st.st_size = (off_t)file_bytes(initial_slots, initial_data);
+        }
+        map(path, (std::uint64_t)st.st_size);
+        const Header &h = *header();
+        if (h.magic != magic || h.version != version || h.slot_count == 0 || (h.slot_count & (h.slot_count - 1)) != 0
+            || file_bytes(h.slot_count, h.data_capacity) != map_size_ || h.data_size > h.data_capacity)
+        {
+            fail(path + " is not a solution store of this version");
+        }
+    }
+
+    void map(const std::string &path, std::uint64_t bytes)
+    {
+        if (bytes < sizeof(Header))
+        {
+            fail(path + " is not a solution store");
+        }
+        void *memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (memory == MAP_FAILED)
+        {
+            fail("cannot map " + path);
+        }
+        map_ = memory;
+        map_size_ = bytes;
+    }
+
+    void close_file()
+    {
+        if (map_ != nullptr)
+        {
+            msync(map_, map_size_, MS_SYNC);
+            munmap(map_, map_size_);
+            map_ = nullptr;
+        }
+        if (fd_ >= 0)
+        {
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    [[noreturn]] void fail(const std::string &what)
+    {
+        close_file();
+        throw std::runtime_error("solution store: " + what);
+    }
+
+    // The data area is last in the file, so it grows by extending it.
+    void grow_data(std::uint64_t capacity)
+    {
+        const std::uint64_t slot_count = header()->slot_count;
+        munmap(map_, map_size_);
+        map_ = nullptr;
+        if (ftruncate(fd_, (off_t)file_bytes(slot_count, capacity)) != 0)
+        {
+            fail("cannot grow " + path_);
+        }
+        map(path_, file_bytes(slot_count, capacity));
+        header()->data_capacity = capacity;
+    }
+
+    // Same records under a table of `slot_count` slots, written to a new
+    // file that then replaces the old one.
+    void rebuild(std::uint64_t slot_count)
+    {
+        const std::string temp = path_ + ".tmp";
+        unlink(temp.c_str());
+        const int fd = open(temp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        const std::uint64_t bytes = file_bytes(slot_count, header()->data_capacity);
+        void *memory = fd >= 0 && flock(fd, LOCK_EX | LOCK_NB) == 0 && ftruncate(fd, (off_t)bytes) == 0
+            ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        if (memory == MAP_FAILED)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            throw std::runtime_error("solution store: cannot rebuild " + path_);
+        }
+        Header *h = static_cast<Header*>(memory);
+        *h = *header();
+        h->slot_count = slot_count;
+        Slot *table = reinterpret_cast<Slot*>(h + 1);
+        for (std::uint64_t i = 0; i < header()->slot_count; i++)
+        {
+            const Slot slot = slots()[i];
+            if (slot.tag == 0)
+            {
+                continue;
+            }
+            // The low bits of the key are gone, but the record still has
+            // the terms to hash them again; the prefix is the one whose
+            // key has the slot's tag.
+            const std::uint32_t terms = record_terms(slot.record);
+            const SequenceView view(record_data(slot.record), terms);
+            for (std::size_t length = terms; length >= min_prefix; length--)
+            {
+                const std::uint64_t key = key_of(view, length);
+                if (tag_of(key) == slot.tag)
+                {
+                    std::uint64_t j = key & (slot_count - 1);
+                    while (table[j].tag != 0)
+                    {
+                        j = (j + 1) & (slot_count - 1);
+                    }
+                    table[j] = slot;
+                    break;
+                }
+            }
+        }
+        std::memcpy(reinterpret_cast<std::uint8_t*>(table + slot_count), data(), header()->data_size);
+        msync(memory, bytes, MS_SYNC);
+        if (rename(temp.c_str(), path_.c_str()) != 0)
+        {
+            munmap(memory, bytes);
+            close(fd);
+            throw std::runtime_error("solution store: cannot replace " + path_);
+        }
+        munmap(map_, map_size_);
+        close(fd_);
+        fd_ = fd;
+        map_ = memory;
+        map_size_ = bytes;
+    }
+
+    std::string path_;
+    int fd_ = -1;
+    void *map_ = nullptr;
+    std::uint64_t map_size_ = 0;
+    mutable std::mutex mutex_;
+};
+
+#endif  // SOLUTION_STORE_H
@@ -0,0 +1,95 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+// The formula search as a library, built as the Solver target.
+//
+// A Solver owns everything a search changes: its worker pool, its seeds,
+// its configuration and the node store its trees are made in. The
+// searches themselves draw every random number from streams derived from
+// their seed and keep their caches to themselves, so solvers on different
+// threads never disturb each other, and a solve gives the same formula
+// whatever else runs. The one lock they meet at is the page source under
+// the stores, taken once per 16 KB page of nodes; formulas a solver
+// returns are strings, so no node outlives its solver.
+//
+// One solve at a time per solver; a server runs a solver per concurrent
+// request, or a pool of them.
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "search_control.h"
+
+struct SolverOptions
+{
+    // Threads of the solver's own pool; 1 runs every solve on the calling
+    // thread alone, 0 takes one per hardware thread.
+    std::size_t threads = 1;
+    // Each solve takes the next seed of a sequence starting from this
+    // one, so a solver started with the same seed repeats its results;
+    // 0 picks a random one.
+    std::uint64_t seed = 0;
+    // Shape of the population, see SearchConfig.
+    std::size_t population_size = 256;
+    std::size_t elite_size = 64;
+    std::size_t max_nodes = 30;
+    // Terms back a formula may read, 2 to 16, and whether it may read the
+    // sum of the terms so far, see SearchConfig. A formula reading further
+    // back than XPP starts from that many terms of the target.
+    std::size_t lookback = 2;
+    bool prefix_sum = false;
+    unsigned jit_threshold = 0;
+    // Budgets of each solve, 0 for none; at least one keeps a target with
+    // no formula in reach from running forever.
+    std::size_t max_generations = 0;
+    std::size_t max_millis = 10000;
+    std::uint64_t max_evaluations = 0;
+};
+
+struct Solution
+{
+    SearchStop stop = SearchStop::generations;
+    // The winner or, without one, the closest formula found, in prefix
+    // notation; empty if the search did not finish a generation.
+    std::string formula;
+    std::string simplified;
+    // Squared error of the formula against the target.
+    std::uint64_t error = UINT64_MAX;
+    std::uint64_t seed = 0;
+    std::uint64_t generations = 0;
+    std::uint64_t evaluations = 0;
+
+    bool solved() const noexcept { return stop == SearchStop::solved; }
+};
+
+class Solver
+{
+public:
+    // Throws std::invalid_argument for a population shape or a lookback no
+    // search can run with.
+    explicit Solver(const SolverOptions &options = SolverOptions());
+    ~Solver();
+
+    Solver(const Solver&) = delete;
+    Solver& operator=(const Solver&) = delete;
+
+    // Searches a formula for `target`, at least 3 terms and more than the
+    // lookback, until it is found or a budget of the options runs out or
+    // `cancel` is cancelled. Each better formula goes to `on_improvement`
+    // on the solving thread as it is found. Throws std::invalid_argument
+    // for a shorter target.
+    Solution solve(const std::vector<int> &target, const CancelToken &cancel = CancelToken(),
+        const std::function<void(const std::string &formula, std::uint64_t error)> &on_improvement = nullptr);
+
+    const SolverOptions& options() const noexcept;
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
+#endif  // SOLVER_H
@@ -0,0 +1,353 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+// Per-generation statistics of a search, summed over `interval`
+// generations and handed to a sink as one TelemetryRow. The generations
+// left over when the search stops make one last, shorter row.
+//
+// On the search thread the recorder costs one timestamp per phase of a
+// generation; the timestamps are TSC reads where there is a TSC, turned
+// into seconds at export against the steady clock over the same span.
+// Workers count into their own cache line, indexed like every other
+// per-worker scratch of the search. The population is only looked at on
+// the generations that are exported.
+//
+// Built with SEQGEN_TELEMETRY=0 the recorder is an empty class whose
+// members do nothing, so the calls in the search compile to nothing.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#ifndef SEQGEN_TELEMETRY
+#define SEQGEN_TELEMETRY 1
+#endif
+
+#if SEQGEN_TELEMETRY && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+struct TelemetryRow
+{
+    std::uint64_t seed;
+    // Last generation of the interval, counting from 1.
+    std::uint64_t generation;
+    // Since the search started.
+    double seconds;
+    // Scores at that generation: best and median of the individuals not
+    // bred out as duplicates, mean nodes per tree, and the duplicates, which
+    // rank last with an infinite score whatever their error.
+    double best;
+    double median;
+    double mean_size;
+    std::uint64_t duplicates;
+    // Over the interval: trees regrown for exceeding the size limit,
+    // individuals evaluated rather than answered by the fitness cache, and
+    // nodes made in the store of the search.
+    std::uint64_t resets;
+    std::uint64_t evaluations;
+    double evaluations_per_second;
+    std::uint64_t allocations;
+    // Milliseconds per generation in each phase; rank includes the
+    // search's on_generation hook.
+    double compile_ms;
+    double evaluate_ms;
+    double rank_ms;
+    double breed_ms;
+};
+
+using TelemetrySink = std::function<void(const TelemetryRow&)>;
+
+namespace telemetry_detail
+{
+
+// JSON has no infinity.
+inline void write_number(std::ostream &strm, double value, bool json)
+{
+    if (std::isfinite(value) || !json)
+    {
+        strm << value;
+    }
+    else
+    {
+        strm << "null";
+    }
+}
+
+inline void write_row(std::ostream &strm, const TelemetryRow &row, bool json)
+{
+    const char *const names[] = { "seed", "generation", "seconds", "best", "median", "mean_size", "duplicates", "resets",
+        "evaluations", "evaluations_per_second", "allocations", "compile_ms", "evaluate_ms", "rank_ms", "breed_ms" };
+    std::size_t field = 0;
+    auto next = [&strm, &names, &field, json]() -> std::ostream& {
+        if (field != 0)
+        {
+            strm << ",";
+        }
+        if (json)
+        {
+            strm << "\"" << names[field] << "\":";
+        }
+        field++;
+        return strm;
+    };
+
+    strm << (json ? "{" : "");
+    next() << row.seed;
+    next() << row.generation;
+    next() << row.seconds;
+    write_number(next(), row.best, json);
+    write_number(next(), row.median, json);
+    next() << row.mean_size;
+    next() << row.duplicates;
+    next() << row.resets;
+    next() << row.evaluations;
+    next() << row.evaluations_per_second;
+    next() << row.allocations;
+    next() << row.compile_ms;
+    next() << row.evaluate_ms;
+    next() << row.rank_ms;
+    next() << row.breed_ms;
+    strm << (json ? "}" : "") << "\n";
+}
+
+}  // namespace telemetry_detail
+
+// Sinks writing to `strm`, one line per row; a CSV one starts with a
+// header. Searches running at once may share a sink.
+inline TelemetrySink telemetry_csv(std::ostream &strm)
+{
+    auto mutex = std::make_shared<std::mutex>();
+    auto header = std::make_shared<bool>(true);
+    return [&strm, mutex, header](const TelemetryRow &row) {
+        std::lock_guard<std::mutex> lock(*mutex);
+        if (*header)
+        {
+            strm << "seed,generation,seconds,best,median,mean_size,duplicates,resets,evaluations,"
+                    "evaluations_per_second,allocations,compile_ms,evaluate_ms,rank_ms,breed_ms\n";
+            *header = false;
+        }
+        telemetry_detail::write_row(strm, row, false);
+        strm.flush();
+    };
+}
+
+inline TelemetrySink telemetry_json(std::ostream &strm)
+{
+    auto mutex = std::make_shared<std::mutex>();
+    return [&strm, mutex](const TelemetryRow &row) {
+        std::lock_guard<std::mutex> lock(*mutex);
+        telemetry_detail::write_row(strm, row, true);
+        strm.flush();
+    };
+}
+
+inline std::uint64_t telemetry_ticks()
+{
+#if SEQGEN_TELEMETRY && (defined(__x86_64__) || defined(__i386__))
+    return __rdtsc();
+#else
+    return (std::uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+#if SEQGEN_TELEMETRY
+
+class TelemetryRecorder
+{
+public:
+    enum Phase { compile, evaluate, rank, breed, phases };
+
+    // Records nothing without a sink. `allocations` reads the count of
+    // nodes made in the store of the search.
+    TelemetryRecorder(const TelemetrySink &sink, std::size_t interval, std::size_t workers, std::uint64_t seed,
+        std::function<std::uint64_t()> allocations)
+        : sink_(sink), interval_(interval != 0 ? interval : 1), seed_(seed), allocations_(std::move(allocations))
+    {
+        if (!enabled())
+        {
+            return;
+        }
+        counters_.resize(workers);
+        interval_ticks_ = telemetry_ticks();
+        start_time_ = interval_time_ = std::chrono::steady_clock::now();
+        interval_allocations_ = allocations_();
+    }
+
+    bool enabled() const noexcept { return (bool)sink_; }
+
+    void start_generation()
+    {
+        if (enabled())
+        {
+            mark_ = telemetry_ticks();
+            generations_++;
+        }
+    }
+
+    // Ends the phase running since the last mark.
+    void end_phase(Phase phase)
+    {
+        if (enabled())
+        {
+            const std::uint64_t now = telemetry_ticks();
+            phase_ticks_[phase] += now - mark_;
+            mark_ = now;
+        }
+    }
+
+    void count_reset(std::size_t worker)
+    {
+        if (enabled())
+        {
+            counters_[worker].resets++;
+        }
+    }
+
+    void count_evaluations(std::uint64_t count)
+    {
+        if (enabled())
+        {
+            evaluations_ += count;
+        }
+    }
+
+    // After breeding, while `ranking` still indexes `population`, which
+    // hold at least one individual. The first of every output is never a
+    // duplicate, so some score is finite.
+    template <class Population, class Ranking>
+    void end_generation(std::size_t generation, const Population &population, const Ranking &ranking)
+    {
+        if (enabled() && (generation + 1) % interval_ == 0)
+        {
+            export_row(generation, population, ranking);
+        }
+    }
+
+    // When the search stops after `generation`, with a ranking of
+    // `population` as for end_generation. Exports the generations since
+    // the last row, if there are any.
+    template <class Population, class Ranking>
+    void finish(std::size_t generation, const Population &population, const Ranking &ranking)
+    {
+        if (enabled() && generations_ != 0)
+        {
+            export_row(generation, population, ranking);
+        }
+    }
+
+private:
+    // A cache line each, so workers do not write into each other's.
+    struct Counters
+    {
+        std::uint64_t resets = 0;
+        char padding[56];
+    };
+
+    template <class Population, class Ranking>
+    void export_row(std::size_t generation, const Population &population, const Ranking &ranking)
+    {
+        const std::uint64_t ticks = telemetry_ticks();
+        const auto time = std::chrono::steady_clock::now();
+        const double elapsed = std::chrono::duration<double>(time - interval_time_).count();
+        const double seconds_per_tick = ticks != interval_ticks_ ? elapsed / (double)(ticks - interval_ticks_) : 0.;
+
+        TelemetryRow row{};
+        row.seed = seed_;
+        row.generation = generation + 1;
+        row.seconds = std::chrono::duration<double>(time - start_time_).count();
+
+        scores_.clear();
+        double nodes = 0.;
+        for (const auto &entry : ranking)
+        {
+            if (std::isinf(entry.first))
+            {
+                row.duplicates++;
+            }
+            else
+            {
+                scores_.push_back(entry.first);
+            }
+            nodes += population[entry.second]->size();
+        }
+        std::nth_element(scores_.begin(), scores_.begin() + scores_.size() / 2, scores_.end());
+        row.median = scores_[scores_.size() / 2];
+        row.best = *std::min_element(scores_.begin(), scores_.end());
+        row.mean_size = nodes / ranking.size();
+
+        for (Counters &counters : counters_)
+        {
+            row.resets += counters.resets;
+            counters.resets = 0;
+        }
+        row.evaluations = evaluations_;
+        row.evaluations_per_second = elapsed > 0. ? evaluations_ / elapsed : 0.;
+        const std::uint64_t allocations = allocations_();
+        row.allocations = allocations - interval_allocations_;
+
+        double *const phase_ms[] = { &row.compile_ms, &row.evaluate_ms, &row.rank_ms, &row.breed_ms };
+        for (int phase = 0; phase < phases; phase++)
+        {
+            *phase_ms[phase] = phase_ticks_[phase] * seconds_per_tick * 1e3 / generations_;
+            phase_ticks_[phase] = 0;
+        }
+
+        generations_ = 0;
+        evaluations_ = 0;
+        interval_allocations_ = allocations;
+        sink_(row);
+        // The sink's own time goes to no phase.
+        interval_ticks_ = telemetry_ticks();
+        interval_time_ = std::chrono::steady_clock::now();
+    }
+
+    TelemetrySink sink_;
+    std::size_t interval_;
+    std::uint64_t seed_;
+    std::function<std::uint64_t()> allocations_;
+    std::vector<Counters> counters_;
+    std::vector<double> scores_;
+    std::uint64_t mark_ = 0;
+    // Started since the last row.
+    std::size_t generations_ = 0;
+    std::uint64_t phase_ticks_[phases] = {};
+    std::uint64_t evaluations_ = 0;
+    std::uint64_t interval_allocations_ = 0;
+    std::uint64_t interval_ticks_ = 0;
+    std::chrono::steady_clock::time_point start_time_;
+    std::chrono::steady_clock::time_point interval_time_;
+};
+
+#else
+
+class TelemetryRecorder
+{
+public:
+    enum Phase { compile, evaluate, rank, breed, phases };
+
+    template <class... Args>
+    explicit TelemetryRecorder(const Args&...) {}
+
+    static constexpr bool enabled() noexcept { return false; }
+    void start_generation() {}
+    void end_phase(Phase) {}
+    void count_reset(std::size_t) {}
+    void count_evaluations(std::uint64_t) {}
+
+    template <class Population, class Ranking>
+    void end_generation(std::size_t, const Population&, const Ranking&) {}
+    template <class Population, class Ranking>
+    void finish(std::size_t, const Population&, const Ranking&) {}
+};
+
+#endif  // SEQGEN_TELEMETRY
+
+#endif  // TELEMETRY_H
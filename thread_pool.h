@@ -0,0 +1,153 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// Persistent workers for data-parallel loops. The calling thread takes
+// part in every loop, so a pool of size 1 has no worker threads at all
+// and runs everything inline.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    // 0 means one thread per hardware thread.
+    explicit ThreadPool(std::size_t threads = 0)
+    {
+        if (threads == 0)
+        {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (std::size_t w = 1; w < threads; w++)
+        {
+            workers_.emplace_back([this, w] { worker_loop(w); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread &worker : workers_)
+        {
+            worker.join();
+        }
+    }
+
+    std::size_t size() const noexcept { return workers_.size() + 1; }
+
+    // Calls fn(worker, begin, end) on chunks of at most `grain` indices
+    // covering [0, count) and returns when all of them are done. `worker`
+    // is below size() and no two chunks run with the same worker at once,
+    // so it can index per-thread scratch. The first exception thrown by
+    // fn is rethrown here.
+    template <class F>
+    void parallel_for(std::size_t count, std::size_t grain, F &&fn)
+    {
+        grain = std::max<std::size_t>(grain, 1);
+        if (workers_.empty() || count <= grain)
+        {
+            fn(std::size_t(0), std::size_t(0), count);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            context_ = &fn;
+            call_ = [](void *context, std::size_t worker, std::size_t begin, std::size_t end) {
+                (*static_cast<F*>(context))(worker, begin, end);
+            };
+            count_ = count;
+            grain_ = grain;
+            next_.store(0, std::memory_order_relaxed);
+            active_ = workers_.size();
+            error_ = nullptr;
+            epoch_++;
+        }
+        wake_.notify_all();
+        run_chunks(0);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return active_ == 0; });
+        if (error_)
+        {
+            std::rethrow_exception(error_);
+        }
+    }
+
+private:
+    void worker_loop(std::size_t worker)
+    {
+        std::uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            wake_.wait(lock, [this, seen] { return stop_ || epoch_ != seen; });
+            if (stop_)
+            {
+                return;
+            }
+            seen = epoch_;
+            lock.unlock();
+            run_chunks(worker);
+            lock.lock();
+            if (--active_ == 0)
+            {
+                done_.notify_one();
+            }
+        }
+    }
+
+    void run_chunks(std::size_t worker)
+    {
+        while (true)
+        {
+            const std::size_t begin = next_.fetch_add(grain_, std::memory_order_relaxed);
+            if (begin >= count_)
+            {
+                return;
+            }
+            try
+            {
+                call_(context_, worker, begin, std::min(begin + grain_, count_));
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!error_)
+                {
+                    error_ = std::current_exception();
+                }
+            }
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::uint64_t epoch_ = 0;
+    bool stop_ = false;
+    std::size_t active_ = 0;
+    std::exception_ptr error_;
+
+    void *context_ = nullptr;
+    void (*call_)(void*, std::size_t, std::size_t, std::size_t) = nullptr;
+    std::size_t count_ = 0;
+    std::size_t grain_ = 1;
+    std::atomic<std::size_t> next_{ 0 };
+};
+
+#endif  // THREAD_POOL_H